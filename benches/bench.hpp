@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "rt/metrics.hpp"
+
+
+namespace bench {
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+// prevents compiler from optimizing away computation of value
+template <typename T>
+inline void do_not_optimize(T value) {
+  static volatile T sink;
+  sink = value;
+}
+
+struct Stats {
+  std::uint64_t ops{0};
+  double mean{0};
+  double p50{0};
+  double p90{0};
+  double p99{0};
+};
+
+// samples are ns per op measured for each batch
+inline Stats summarize(std::vector<double> samples, std::uint64_t ops) {
+  Stats stats;
+  stats.ops = ops;
+  if (samples.empty()) {
+    return stats;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (auto s : samples) {
+    sum += s;
+  }
+  stats.mean = sum / static_cast<double>(samples.size());
+
+  const auto at = [&](double p) {
+    return samples[static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1))];
+  };
+  stats.p50 = at(0.50);
+  stats.p90 = at(0.90);
+  stats.p99 = at(0.99);
+  return stats;
+}
+
+// one JSON object per line, so results are easy to diff and parse
+inline void report(const char* name, const Stats& stats, const char* extra = "") {
+  std::printf(
+      "{\"bench\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,\"p50\":%.2f,"
+      "\"p90\":%.2f,\"p99\":%.2f%s}\n",
+      name, static_cast<unsigned long long>(stats.ops), stats.mean, stats.p50,
+      stats.p90, stats.p99, extra);
+  std::fflush(stdout);
+}
+
+constexpr std::size_t SAMPLES = 101;
+
+// Runs run_batch(batch) SAMPLES times after a warm up, each call should
+// execute exactly batch operations
+template <typename F>
+Stats measure(std::size_t batch, F&& run_batch) {
+  run_batch(batch);
+
+  std::vector<double> samples;
+  samples.reserve(SAMPLES);
+  for (std::size_t i = 0; i < SAMPLES; ++i) {
+    const auto start = rt::monotonic_ns();
+    run_batch(batch);
+    const auto elapsed = rt::monotonic_ns() - start;
+    samples.push_back(static_cast<double>(elapsed) / static_cast<double>(batch));
+  }
+
+  return summarize(std::move(samples), std::uint64_t{batch} * SAMPLES);
+}
+
+// HDR-style histogram: exact below 64, above that values are grouped into 32
+// linear sub-buckets per power of two, so relative error stays under ~3%
+class LatencyHistogram {
+ public:
+  void record(std::uint64_t value) noexcept {
+    ++m_counts[index(value)];
+    ++m_count;
+    m_max = (std::max)(m_max, value);
+  }
+
+  void merge(const LatencyHistogram& other) noexcept {
+    for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+      m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_max = (std::max)(m_max, other.m_max);
+  }
+
+  std::uint64_t count() const noexcept { return m_count; }
+  std::uint64_t max() const noexcept { return m_max; }
+
+  // p is in [0, 1], returns lower bound of the bucket
+  std::uint64_t percentile(double p) const noexcept {
+    if (m_count == 0) {
+      return 0;
+    }
+
+    const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(m_count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+      seen += m_counts[i];
+      if (seen >= rank) {
+        return lower_bound(i);
+      }
+    }
+    return m_max;
+  }
+
+ private:
+  static constexpr std::size_t SUB_BUCKETS = 32;
+  static constexpr std::size_t EXACT = 2 * SUB_BUCKETS;
+  static constexpr std::size_t N_BUCKETS = EXACT + (64 - 6) * SUB_BUCKETS;
+
+  static std::size_t index(std::uint64_t value) noexcept {
+    if (value < EXACT) {
+      return static_cast<std::size_t>(value);
+    }
+
+    // width is in [7, 64], value >> shift is in [32, 64)
+    const auto width = static_cast<std::size_t>(std::bit_width(value));
+    const auto shift = width - 6;
+    return EXACT + (width - 7) * SUB_BUCKETS +
+           static_cast<std::size_t>((value >> shift) - SUB_BUCKETS);
+  }
+
+  static std::uint64_t lower_bound(std::size_t i) noexcept {
+    if (i < EXACT) {
+      return i;
+    }
+
+    const auto width = (i - EXACT) / SUB_BUCKETS + 7;
+    const auto sub = (i - EXACT) % SUB_BUCKETS + SUB_BUCKETS;
+    return std::uint64_t{sub} << (width - 6);
+  }
+
+  std::array<std::uint64_t, N_BUCKETS> m_counts{};
+  std::uint64_t m_count{0};
+  std::uint64_t m_max{0};
+};
+
+}  // namespace bench
@@ -0,0 +1,242 @@
+// Closed-loop HTTP/1.1 load generator built on the runtime.
+//
+// Opens `connections` keep-alive connections, each sends `pipeline` requests
+// at once and waits for all responses before sending the next batch. Latency
+// of a request is measured from sending its batch to receiving its response.
+//
+// With "loopback" instead of an ip, the HelloWorld server of tests/main.cpp
+// runs in the same runtime and connections are LoopbackStreams, which
+// measures the runtime and the HTTP path without the kernel.
+//
+// usage: rt_http_load [ip|loopback] [port] [connections] [pipeline] [seconds] [threads]
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "benches/bench.hpp"
+#include "rt/loopback.hpp"
+#include "rt/runtime.hpp"
+#include "rt/socket.hpp"
+#include "rt/stream.hpp"
+#include "tests/hello_world.hpp"
+
+
+struct LoadState {
+  const char* name{"http_load"};
+  std::string requests;  // pipelined batch
+  std::size_t pipeline{0};
+  std::uint64_t start{0};
+  std::uint64_t deadline{0};
+
+  std::atomic<std::size_t> running{0};
+  std::mutex lock;
+  bench::LatencyHistogram latency;  // guarded by lock
+  std::uint64_t errors{0};          // guarded by lock
+};
+
+static void report(LoadState& state) {
+  const auto elapsed_ns = rt::monotonic_ns() - state.start;
+  const auto& h = state.latency;
+  const auto seconds = static_cast<double>(elapsed_ns) / 1e9;
+  const auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1e3; };
+  std::printf(
+      "{\"bench\":\"%s\",\"requests\":%llu,\"errors\":%llu,"
+      "\"seconds\":%.3f,\"rps\":%.0f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+      "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}\n",
+      state.name, static_cast<unsigned long long>(h.count()),
+      static_cast<unsigned long long>(state.errors), seconds,
+      static_cast<double>(h.count()) / seconds, us(h.percentile(0.50)),
+      us(h.percentile(0.90)), us(h.percentile(0.99)), us(h.percentile(0.999)),
+      us(h.max()));
+  std::fflush(stdout);
+}
+
+// returns size of the first complete response in data or 0
+static std::size_t response_size(std::string_view data) {
+  const auto headers_end = data.find("\r\n\r\n");
+  if (headers_end == std::string_view::npos) {
+    return 0;
+  }
+
+  const auto headers = data.substr(0, headers_end);
+  std::size_t content_length = 0;
+  constexpr std::string_view field = "\r\nContent-Length:";
+  const auto pos = headers.find(field);
+  if (pos != std::string_view::npos) {
+    auto i = pos + field.size();
+    while (i < headers.size() && headers[i] == ' ') {
+      ++i;
+    }
+    while (i < headers.size() && headers[i] >= '0' && headers[i] <= '9') {
+      content_length = content_length * 10 + static_cast<std::size_t>(headers[i] - '0');
+      ++i;
+    }
+  }
+
+  const auto total = headers_end + 4 + content_length;
+  return total <= data.size() ? total : 0;
+}
+
+struct Connection {
+  void operator()() const {
+    // NOTE: task stack is only 32KiB
+    auto latency = std::make_unique<bench::LatencyHistogram>();
+    const auto errors = run(*latency);
+
+    {
+      std::lock_guard guard{state->lock};
+      state->latency.merge(*latency);
+      state->errors += errors;
+    }
+
+    if (state->running.fetch_sub(1) == 1) {
+      report(*state);
+      // Runtime::run() never returns
+      std::exit(EXIT_SUCCESS);
+    }
+  }
+
+  std::uint64_t run(bench::LatencyHistogram& latency) const {
+    if (loopback) {
+      auto s = rt::LoopbackStream::connect(port);
+      if (auto e = s.err()) {
+        std::fprintf(stderr, "connect() failed: %s\n", e.message().c_str());
+        return 1;
+      }
+
+      return exchange(*s, latency);
+    }
+
+    auto s = rt::Socket::connect(ip, port);
+    if (auto e = s.err()) {
+      std::fprintf(stderr, "connect() failed: %s\n", e.message().c_str());
+      return 1;
+    }
+
+    return exchange(*s, latency);
+  }
+
+  std::uint64_t exchange(rt::StreamRef s, bench::LatencyHistogram& latency) const {
+    constexpr std::size_t buffer_size = 16 * 1024;
+    auto buffer = std::make_unique<char[]>(buffer_size);
+    std::size_t received = 0;
+
+    while (rt::monotonic_ns() < state->deadline) {
+      const auto sent_at = rt::monotonic_ns();
+      if (auto e = s.send_all(state->requests.data(), state->requests.size())) {
+        std::fprintf(stderr, "send() failed: %s\n", e.message().c_str());
+        return 1;
+      }
+
+      std::size_t responses = 0;
+      while (responses < state->pipeline) {
+        auto n = s.recv(buffer.get() + received, buffer_size - received);
+        if (auto e = n.err()) {
+          std::fprintf(stderr, "recv() failed: %s\n", e.message().c_str());
+          return 1;
+        }
+
+        if (*n == 0) {
+          std::fprintf(stderr, "connection closed by server\n");
+          return 1;
+        }
+        received += *n;
+
+        const auto now = rt::monotonic_ns();
+        std::size_t offset = 0;
+        while (auto size = response_size({buffer.get() + offset, received - offset})) {
+          latency.record(now - sent_at);
+          offset += size;
+          ++responses;
+        }
+
+        if (offset == 0 && received == buffer_size) {
+          std::fprintf(stderr, "response is too large\n");
+          return 1;
+        }
+
+        std::memmove(buffer.get(), buffer.get() + offset, received - offset);
+        received -= offset;
+      }
+    }
+
+    s.shutdown();
+    return 0;
+  }
+
+  LoadState* state;
+  rt::IpAddr ip;
+  rt::Port port;
+  bool loopback;
+};
+
+static rt::IpAddr parse_ip(const char* s) {
+  rt::IpAddr ip{};
+  for (auto& byte : ip) {
+    char* end = nullptr;
+    byte = static_cast<std::uint8_t>(std::strtoul(s, &end, 10));
+    s = *end == '.' ? end + 1 : end;
+  }
+  return ip;
+}
+
+int main(int argc, char** argv) {
+  const auto arg = [&](int i, const char* fallback) {
+    return i < argc ? argv[i] : fallback;
+  };
+
+  const bool loopback = std::strcmp(arg(1, ""), "loopback") == 0;
+  const auto ip = parse_ip(loopback ? "127.0.0.1" : arg(1, "127.0.0.1"));
+  const auto port = static_cast<rt::Port>(std::atoi(arg(2, "8080")));
+  const auto connections = static_cast<std::size_t>(std::atoi(arg(3, "64")));
+  const auto pipeline = static_cast<std::size_t>(std::atoi(arg(4, "16")));
+  const auto seconds = static_cast<std::uint64_t>(std::atoi(arg(5, "10")));
+  const auto threads = static_cast<std::size_t>(std::atoi(arg(6, "0")));
+
+  auto runtime = rt::Runtime::create(threads);
+  if (auto e = runtime.err()) {
+    std::fprintf(stderr, "Failed to initialize runtime: %s\n", e.message().c_str());
+    return EXIT_FAILURE;
+  }
+
+  constexpr std::string_view request =
+      "GET / HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n";
+
+  static LoadState state;
+  for (std::size_t i = 0; i < pipeline; ++i) {
+    state.requests += request;
+  }
+  state.pipeline = pipeline;
+  state.running = connections;
+  state.start = rt::monotonic_ns();
+  state.deadline = state.start + seconds * 1'000'000'000ull;
+
+  if (loopback) {
+    // bound before any connection is spawned, so none of them is refused
+    static auto listener = rt::LoopbackListener::bind(port);
+    if (auto e = listener.err()) {
+      std::fprintf(stderr, "bind() failed: %s\n", e.message().c_str());
+      return EXIT_FAILURE;
+    }
+
+    state.name = "http_load_loopback";
+    runtime->spawn([] { accept_hello_world(*listener); });
+  }
+
+  for (std::size_t i = 0; i < connections; ++i) {
+    runtime->spawn(Connection{&state, ip, port, loopback});
+  }
+
+  runtime->run();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+# Runs the HelloWorld server (rt) and the load generator (rt_http_load) on
+# disjoint sets of cores and prints the load generator's JSON result.
+#
+# usage: .\benches\run_http_bench.ps1 -BuildDir out\build\x64-Release
+#          [-ServerCores 4] [-ClientCores 4] [-Connections 64] [-Pipeline 16]
+#          [-Seconds 10] [-Port 8080]
+param(
+  [string]$BuildDir = "out\build\x64-Release",
+  [int]$ServerCores = 4,
+  [int]$ClientCores = 4,
+  [int]$Connections = 64,
+  [int]$Pipeline = 16,
+  [int]$Seconds = 10,
+  [int]$Port = 8080
+)
+
+$ErrorActionPreference = "Stop"
+
+$total = [Environment]::ProcessorCount
+if ($ServerCores + $ClientCores -gt $total) {
+  throw "need $($ServerCores + $ClientCores) cores, only $total available"
+}
+
+# server gets the lowest cores, client the ones right after them
+$serverMask = [int64]([math]::Pow(2, $ServerCores) - 1)
+$clientMask = [int64](([math]::Pow(2, $ClientCores) - 1) * [math]::Pow(2, $ServerCores))
+
+$server = Start-Process -FilePath (Join-Path $BuildDir "rt.exe") `
+  -ArgumentList $ServerCores, $Port -PassThru -NoNewWindow
+try {
+  $server.ProcessorAffinity = [IntPtr]$serverMask
+  Start-Sleep -Milliseconds 500
+
+  $client = Start-Process -FilePath (Join-Path $BuildDir "rt_http_load.exe") `
+    -ArgumentList "127.0.0.1", $Port, $Connections, $Pipeline, $Seconds, $ClientCores `
+    -PassThru -NoNewWindow -RedirectStandardOutput "bench_output.txt"
+  $client.ProcessorAffinity = [IntPtr]$clientMask
+  $client.WaitForExit()
+  Get-Content "bench_output.txt"
+} finally {
+  Stop-Process -Id $server.Id -Force
+}
@@ -0,0 +1,450 @@
+// Microbenchmarks of the scheduler primitives.
+//
+// Every benchmark prints a single JSON object per line:
+//   {"bench":"...","ops":N,"ns_per_op":mean,"p50":...,"p90":...,"p99":...}
+// percentiles are taken over per-batch ns/op samples.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benches/bench.hpp"
+#include "rt/cpu_context.hpp"
+#include "rt/loopback.hpp"
+#include "rt/parallel.hpp"
+#include "rt/splice.hpp"
+#include "rt/result.hpp"
+#include "rt/runtime.hpp"
+#include "rt/worker.hpp"
+#include "rt/worker_queue.hpp"
+
+
+extern "C" {
+void rt_task_trampoline();
+}
+
+static rt::CpuContext g_main_ctx{};
+static rt::CpuContext g_fiber_ctx{};
+
+static void fiber_main(void*) {
+  while (true) {
+    rt_cpu_context_swap(&g_fiber_ctx, &g_main_ctx);
+  }
+}
+
+static void bench_context_swap() {
+  constexpr std::size_t stack_size = 64 * 1024;
+  auto stack = std::make_unique<char[]>(stack_size);
+
+  // swapping with itself is a cheap way to capture valid mxcsr and
+  // x87 control word for the new context
+  rt_cpu_context_swap(&g_fiber_ctx, &g_fiber_ctx);
+
+  // same layout as Worker::init_task() creates
+  auto stack_base = reinterpret_cast<std::uint64_t>(stack.get() + stack_size);
+  stack_base &= 0xfffffffffffffff0ull;
+  stack_base -= 32;
+  *reinterpret_cast<std::uint64_t*>(stack_base - 8) =
+      reinterpret_cast<std::uint64_t>(&fiber_main);
+  *reinterpret_cast<std::uint64_t*>(stack_base - 16) = 0;
+  g_fiber_ctx.rsp = stack_base - 16;
+  g_fiber_ctx.rip = reinterpret_cast<std::uint64_t>(&rt_task_trampoline);
+
+  const auto stats = bench::measure(10'000, [](std::size_t batch) {
+    for (std::size_t i = 0; i < batch; ++i) {
+      rt_cpu_context_swap(&g_main_ctx, &g_fiber_ctx);
+    }
+  });
+  bench::report("context_swap_round_trip", stats);
+}
+
+BENCH_NOINLINE static rt::Result<std::size_t> checked_add(std::size_t a, std::size_t b) {
+  if (a + b < a) {
+    return std::make_error_code(std::errc::value_too_large);
+  }
+
+  return a + b;
+}
+
+BENCH_NOINLINE static std::size_t plain_add(std::size_t a, std::size_t b) {
+  return a + b;
+}
+
+static void bench_result() {
+  const auto plain = bench::measure(100'000, [](std::size_t batch) {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < batch; ++i) {
+      sum = plain_add(sum, i);
+    }
+    bench::do_not_optimize(sum);
+  });
+  bench::report("plain_return", plain);
+
+  const auto result = bench::measure(100'000, [](std::size_t batch) {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < batch; ++i) {
+      auto r = checked_add(sum, i);
+      if (!r) {
+        break;
+      }
+      sum = *r;
+    }
+    bench::do_not_optimize(sum);
+  });
+  bench::report("result_return", result);
+}
+
+static void bench_task_allocation() {
+  constexpr std::size_t batch = 64;
+  std::vector<rt::Task*> tasks(batch);
+
+  const auto cold = bench::measure(batch, [&](std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      auto* task = new rt::Task{};
+      task->stack = reinterpret_cast<char*>(std::malloc(rt::Task::STACK_SIZE));
+      tasks[i] = task;
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+      std::free(tasks[i]->stack);
+      delete tasks[i];
+    }
+  });
+  bench::report("task_alloc_cold", cold);
+
+  rt::TaskList freelist;
+  for (std::size_t i = 0; i < batch; ++i) {
+    freelist.push_front(new rt::Task{});
+  }
+
+  const auto reuse = bench::measure(batch, [&](std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      tasks[i] = freelist.pop_front();
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+      freelist.push_front(tasks[i]);
+    }
+  });
+  bench::report("task_alloc_freelist", reuse);
+
+  while (auto* task = freelist.pop_front()) {
+    delete task;
+  }
+}
+
+static void bench_worker_queue(std::size_t n_thieves) {
+  rt::WorkerQueue queue;
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> stolen{0};
+
+  std::vector<std::thread> thieves;
+  for (std::size_t i = 0; i < n_thieves; ++i) {
+    thieves.emplace_back([&] {
+      std::uint64_t n = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (queue.steal()) {
+          ++n;
+        }
+      }
+      stolen += n;
+    });
+  }
+
+  // the queue never dereferences tasks
+  auto* fake = reinterpret_cast<rt::Task*>(std::uintptr_t{0x1000});
+  const auto stats = bench::measure(256, [&](std::size_t batch) {
+    for (std::size_t i = 0; i < batch; ++i) {
+      queue.push(fake);
+    }
+
+    for (std::size_t i = 0; i < batch; ++i) {
+      bench::do_not_optimize(queue.pop());
+    }
+  });
+
+  stop = true;
+  for (auto& t : thieves) {
+    t.join();
+  }
+
+  const auto extra = ",\"thieves\":" + std::to_string(n_thieves) +
+                     ",\"stolen\":" + std::to_string(stolen.load());
+  bench::report("worker_queue_push_pop", stats, extra.c_str());
+}
+
+// Parks current task until n other tasks call done()
+// NOTE: works only on a single worker runtime
+struct Join {
+  explicit Join(std::size_t n) : op(rt::current_task()), pending(n) {}
+
+  void done() {
+    if (--pending == 0) {
+      rt::current_task()->owner->io()->notify(&op);
+    }
+  }
+
+  void wait() {
+    if (pending != 0) {
+      rt::current_task()->block_on_io();
+    }
+  }
+
+  rt::IoOp op;
+  std::size_t pending;
+};
+
+// Round trips of 4KiB messages from a client through copy_bidirectional() to
+// an echo server, all connections are over loopback TCP
+static void bench_relay() {
+  constexpr rt::Port backend_port = 18091;
+  constexpr rt::Port relay_port = 18092;
+  constexpr std::size_t message_size = 4096;
+
+  auto backend = rt::Socket::bind({127, 0, 0, 1}, backend_port);
+  auto relay = rt::Socket::bind({127, 0, 0, 1}, relay_port);
+  if (!backend || !relay) {
+    std::fprintf(stderr, "relay: failed to bind, skipped\n");
+    return;
+  }
+
+  Join join{2};
+  rt::spawn([&join, &backend] {
+    auto c = backend->accept();
+    if (c) {
+      char buffer[message_size];
+      while (true) {
+        const auto n = c->recv(buffer, sizeof(buffer));
+        if (!n || *n == 0 || c->send_all(buffer, *n)) {
+          break;
+        }
+      }
+      (void)c->shutdown_send();
+    }
+    join.done();
+  });
+
+  rt::spawn([&join, &relay, backend_port] {
+    auto client = relay->accept();
+    auto server = rt::Socket::connect({127, 0, 0, 1}, backend_port);
+    if (client && server) {
+      if (auto relayed = rt::copy_bidirectional(*client, *server); !relayed) {
+        std::fprintf(stderr, "relay: %s\n", relayed.err().message().c_str());
+      }
+    }
+    join.done();
+  });
+
+  auto c = rt::Socket::connect({127, 0, 0, 1}, relay_port);
+  if (!c) {
+    std::fprintf(stderr, "relay: failed to connect\n");
+    std::exit(EXIT_FAILURE);
+  }
+
+  static char message[message_size]{};
+  const auto stats = bench::measure(100, [&c](std::size_t batch) {
+    for (std::size_t i = 0; i < batch; ++i) {
+      if (c->send_all(message, sizeof(message))) {
+        return;
+      }
+
+      std::size_t received = 0;
+      while (received < sizeof(message)) {
+        const auto n = c->recv(message + received, sizeof(message) - received);
+        if (!n || *n == 0) {
+          return;
+        }
+        received += *n;
+      }
+    }
+  });
+
+  // EOF travels through the relay to the echo server and back
+  (void)c->shutdown_send();
+  char rest[64];
+  while (true) {
+    const auto n = c->recv(rest, sizeof(rest));
+    if (!n || *n == 0) {
+      break;
+    }
+  }
+  join.wait();
+  bench::report("relay_round_trip_4k", stats);
+}
+
+// Datagrams per second over loopback UDP, sent and received in batches of
+// batch_size per call. The same task sends a batch and then receives it,
+// so at most one batch is in flight and the socket buffers never overflow.
+static void bench_udp(const char* name, std::size_t batch_size) {
+  constexpr rt::Port rx_port = 18093;
+  constexpr rt::Port tx_port = 18094;
+  constexpr std::size_t max_batch = 32;
+  constexpr std::size_t datagram_size = 64;
+  assert(batch_size <= max_batch);
+
+  auto rx = rt::Socket::bind_udp({127, 0, 0, 1}, rx_port);
+  auto tx = rt::Socket::bind_udp({127, 0, 0, 1}, tx_port);
+  if (!rx || !tx) {
+    std::fprintf(stderr, "%s: failed to bind, skipped\n", name);
+    return;
+  }
+
+  static char payload[datagram_size]{};
+  static char buffers[max_batch][datagram_size];
+  rt::Datagram out[max_batch];
+  rt::Datagram in[max_batch];
+  for (std::size_t i = 0; i < max_batch; ++i) {
+    out[i] = {payload, sizeof(payload), sizeof(payload), {127, 0, 0, 1}, rx_port};
+    in[i] = {buffers[i], datagram_size};
+  }
+
+  bool failed = false;
+  const auto stats = bench::measure(1024, [&](std::size_t batch) {
+    for (std::size_t done = 0; done < batch && !failed;) {
+      const auto n = (std::min)(batch_size, batch - done);
+      std::size_t sent = 0;
+      while (sent < n) {
+        const auto s = tx->send_batch(out + sent, n - sent);
+        if (!s) {
+          failed = true;
+          return;
+        }
+        sent += *s;
+      }
+
+      std::size_t received = 0;
+      while (received < n) {
+        const auto r = rx->recv_batch(in + received, n - received);
+        if (!r) {
+          failed = true;
+          return;
+        }
+        received += *r;
+      }
+      done += n;
+    }
+  });
+
+  if (failed) {
+    std::fprintf(stderr, "%s: send/recv failed\n", name);
+    return;
+  }
+
+  const auto extra = ",\"batch\":" + std::to_string(batch_size) +
+                     ",\"packets_per_sec\":" +
+                     std::to_string(static_cast<std::uint64_t>(1e9 / stats.mean));
+  bench::report(name, stats, extra.c_str());
+}
+
+struct SchedulerBenches {
+  void operator()() const {
+    const auto spawn = bench::measure(1'000, [](std::size_t batch) {
+      Join join{batch};
+      for (std::size_t i = 0; i < batch; ++i) {
+        rt::spawn([&join] { join.done(); });
+      }
+      join.wait();
+    });
+    bench::report("spawn_and_complete", spawn);
+
+    const auto yield = bench::measure(10'000, [](std::size_t batch) {
+      Join join{2};
+      const auto yielder = [&join, n = batch / 2] {
+        for (std::size_t i = 0; i < n; ++i) {
+          rt::yield();
+        }
+        join.done();
+      };
+      rt::spawn(yielder);
+      rt::spawn(yielder);
+      join.wait();
+    });
+    bench::report("yield_ping_pong", yield);
+
+    // request/response over an in-memory connection, the cost of a request
+    // to the runtime without the kernel socket path
+    const auto loopback = bench::measure(10'000, [](std::size_t batch) {
+      auto streams = rt::LoopbackStream::pair();
+      auto& client = streams.first;
+      auto& server = streams.second;
+      Join join{1};
+      rt::spawn([&join, &server, batch] {
+        char message[64];
+        for (std::size_t i = 0; i < batch; ++i) {
+          if (!server.recv(message, sizeof(message)) ||
+              server.send_all(message, sizeof(message))) {
+            break;
+          }
+        }
+        join.done();
+      });
+
+      char message[64]{};
+      for (std::size_t i = 0; i < batch; ++i) {
+        if (client.send_all(message, sizeof(message)) ||
+            !client.recv(message, sizeof(message))) {
+          break;
+        }
+      }
+      join.wait();
+    });
+    bench::report("loopback_ping_pong", loopback);
+
+    // fork-join overhead, ops are elements, 64 leaves per call
+    std::vector<std::uint32_t> values(64 * 1024, 1);
+    const auto reduce = bench::measure(values.size(), [&values](std::size_t batch) {
+      const auto sum = rt::parallel_reduce(
+          0, batch, 1024, std::uint64_t{0},
+          [&values](std::size_t first, std::size_t last) {
+            std::uint64_t s = 0;
+            for (auto i = first; i < last; ++i) {
+              s += values[i];
+            }
+            return s;
+          },
+          [](std::uint64_t a, std::uint64_t b) { return a + b; });
+      bench::do_not_optimize(sum);
+    });
+    bench::report("parallel_reduce_sum", reduce);
+
+    bench_relay();
+
+    // each datagram is still its own recvfrom()/sendto(), batching only
+    // amortizes parking and waking the task over up to 32 of them
+    bench_udp("udp_single", 1);
+    bench_udp("udp_batch", 32);
+
+    // Runtime::run() never returns
+    std::exit(EXIT_SUCCESS);
+  }
+};
+
+int main() {
+  bench_context_swap();
+  bench_result();
+  bench_task_allocation();
+
+  const auto max_thieves =
+      (std::min)(std::size_t{8}, std::size_t{std::thread::hardware_concurrency()});
+  for (std::size_t n = 0; n < max_thieves; ++n) {
+    bench_worker_queue(n);
+  }
+
+  // single worker, so nothing is stolen and Join doesn't need atomics
+  auto runtime = rt::Runtime::create(1);
+  if (auto e = runtime.err()) {
+    std::fprintf(stderr, "Failed to initialize runtime: %s\n", e.message().c_str());
+    return EXIT_FAILURE;
+  }
+
+  runtime->spawn(SchedulerBenches{});
+  runtime->run();
+  return EXIT_SUCCESS;
+}
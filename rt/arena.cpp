@@ -0,0 +1,92 @@
+#include "arena.hpp"
+#include "worker.hpp"
+
+#include <cstdlib>
+
+
+namespace rt {
+
+ChunkPool::~ChunkPool() noexcept {
+  while (auto* chunk = m_free) {
+    m_free = chunk->next;
+    std::free(chunk);
+  }
+}
+
+detail::ArenaChunk* ChunkPool::acquire(std::size_t size) noexcept {
+  if (size <= CHUNK_SIZE && m_free) {
+    auto* chunk = m_free;
+    m_free = chunk->next;
+    --m_cached;
+    chunk->next = nullptr;
+    return chunk;
+  }
+
+  // oversized allocations get a dedicated chunk which is never cached
+  const auto n = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+  auto* p = std::malloc(sizeof(detail::ArenaChunk) + n);
+  if (!p) {
+    return nullptr;
+  }
+
+  return new (p) detail::ArenaChunk{nullptr, n};
+}
+
+void ChunkPool::release(detail::ArenaChunk* chunk) noexcept {
+  if (chunk->size != CHUNK_SIZE || m_cached >= MAX_CACHED) {
+    std::free(chunk);
+    return;
+  }
+
+  chunk->next = m_free;
+  m_free = chunk;
+  ++m_cached;
+}
+
+Arena::~Arena() noexcept {
+  // NOTE: normally chunks are returned in reset(), this only happens when
+  //       runtime is destroyed with unfinished tasks
+  while (auto* chunk = m_chunks) {
+    m_chunks = chunk->next;
+    std::free(chunk);
+  }
+}
+
+void* Arena::bump_slow(std::size_t size, std::size_t align) noexcept {
+  auto* pool = current_task()->owner->chunk_pool();
+  auto* chunk = pool->acquire(size + align - 1);
+  if (!chunk) {
+    return nullptr;
+  }
+
+  chunk->next = m_chunks;
+  m_chunks = chunk;
+  m_allocated += chunk->size;
+
+  auto p = reinterpret_cast<std::uintptr_t>(chunk->data());
+  p = (p + (align - 1)) & ~static_cast<std::uintptr_t>(align - 1);
+  const auto end = reinterpret_cast<std::uintptr_t>(chunk->data()) + chunk->size;
+  // keep bumping the current chunk if the new one is dedicated to this
+  // allocation and the current one has more space left
+  if (chunk->size == ChunkPool::CHUNK_SIZE || end - (p + size) > m_end - m_cur) {
+    m_cur = p + size;
+    m_end = end;
+  }
+
+  return reinterpret_cast<void*>(p);
+}
+
+void Arena::reset(ChunkPool& pool) noexcept {
+  while (auto* chunk = m_chunks) {
+    m_chunks = chunk->next;
+    pool.release(chunk);
+  }
+
+  m_cur = 0;
+  m_end = 0;
+  m_allocated = 0;
+}
+
+Arena* task_arena() noexcept { return &current_task()->arena; }
+
+} // namespace rt
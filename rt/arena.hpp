@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+
+namespace rt {
+
+namespace detail {
+
+struct ArenaChunk {
+  ArenaChunk* next{nullptr};
+  std::size_t size{0};  // usable bytes following the header
+
+  char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+};
+
+}  // namespace detail
+
+// Per-worker cache of fixed size arena chunks. Only the owning worker thread
+// touches it, so there is no synchronization.
+class ChunkPool {
+ public:
+  static constexpr std::size_t CHUNK_SIZE = 16 * 1024 - sizeof(detail::ArenaChunk);
+  static constexpr std::size_t MAX_CACHED = 256;
+
+  ChunkPool() noexcept = default;
+  ChunkPool(const ChunkPool&) = delete;
+  ChunkPool(ChunkPool&& other) noexcept
+      : m_free(other.m_free), m_cached(other.m_cached) {
+    other.m_free = nullptr;
+    other.m_cached = 0;
+  }
+  ChunkPool& operator=(const ChunkPool&) = delete;
+  ChunkPool& operator=(ChunkPool&&) = delete;
+  ~ChunkPool() noexcept;
+
+  // returns nullptr if out of memory
+  detail::ArenaChunk* acquire(std::size_t size) noexcept;
+  void release(detail::ArenaChunk* chunk) noexcept;
+  std::size_t cached() const noexcept { return m_cached; }
+
+ private:
+  detail::ArenaChunk* m_free{nullptr};
+  std::size_t m_cached{0};
+};
+
+// Bump allocator owned by a task. Memory is handed back all at once when the
+// task completes, deallocation of anything but the last allocation is a
+// no-op. Chunks are taken from the pool of the worker the task currently
+// runs on.
+// NOTE: use only from the owning task
+class Arena final : public std::pmr::memory_resource {
+ public:
+  Arena() noexcept = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  ~Arena() noexcept override;
+
+  // returns nullptr if out of memory
+  void* bump(std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept {
+    auto p = (m_cur + (align - 1)) & ~static_cast<std::uintptr_t>(align - 1);
+    if (p >= m_cur && p < m_end && size <= m_end - p) {
+      m_cur = p + size;
+      return reinterpret_cast<void*>(p);
+    }
+
+    return bump_slow(size, align);
+  }
+
+  // reclaims memory only if p was the last allocation
+  void unbump(void* p, std::size_t size) noexcept {
+    if (reinterpret_cast<std::uintptr_t>(p) + size == m_cur) {
+      m_cur = reinterpret_cast<std::uintptr_t>(p);
+    }
+  }
+
+  // returns all chunks to pool
+  void reset(ChunkPool& pool) noexcept;
+  std::size_t allocated() const noexcept { return m_allocated; }
+
+ private:
+  void* bump_slow(std::size_t size, std::size_t align) noexcept;
+
+  void* do_allocate(std::size_t size, std::size_t align) override {
+    auto* p = bump(size, align);
+    if (!p) {
+      throw std::bad_alloc{};
+    }
+    return p;
+  }
+  void do_deallocate(void* p, std::size_t size, std::size_t) override {
+    unbump(p, size);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  detail::ArenaChunk* m_chunks{nullptr};
+  std::uintptr_t m_cur{0};
+  std::uintptr_t m_end{0};
+  std::size_t m_allocated{0};  // bytes in chunks
+};
+
+// STL allocator over an Arena, e.g. std::vector<int, ArenaAllocator<int>>
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) noexcept : m_arena(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.arena()) {}
+
+  T* allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+      throw std::bad_array_new_length{};
+    }
+
+    auto* p = m_arena->bump(n * sizeof(T), alignof(T));
+    if (!p) {
+      throw std::bad_alloc{};
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept { m_arena->unbump(p, n * sizeof(T)); }
+
+  Arena* arena() const noexcept { return m_arena; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const noexcept {
+    return m_arena == other.arena();
+  }
+
+ private:
+  Arena* m_arena;
+};
+
+// Arena of the current task, its memory is released when the task completes
+Arena* task_arena() noexcept;
+
+template <typename T>
+ArenaAllocator<T> task_allocator() noexcept {
+  return ArenaAllocator<T>{task_arena()};
+}
+
+} // namespace rt
@@ -0,0 +1,81 @@
+#include "blocking_pool.hpp"
+
+#include <cassert>
+#include <thread>
+
+
+namespace rt {
+
+BlockingPool::~BlockingPool() noexcept {
+  std::unique_lock lock{m_lock};
+  m_shutdown = true;
+  m_wakeup.notify_all();
+  m_exited.wait(lock, [this] { return m_threads == 0; });
+}
+
+void BlockingPool::submit(detail::BlockingJob* job) noexcept {
+  assert(job->engine);
+  std::unique_lock lock{m_lock};
+  job->next = nullptr;
+  if (m_last) {
+    m_last->next = job;
+  } else {
+    m_first = job;
+  }
+  m_last = job;
+  ++m_queued;
+
+  if (m_queued <= m_idle) {
+    m_wakeup.notify_one();
+    return;
+  }
+
+  if (m_threads < m_config.max_threads) {
+    ++m_threads;
+    // NOTE: threads are detached, destructor waits for m_threads to drop to 0
+    std::thread([this] { thread_main(); }).detach();
+    return;
+  }
+
+  // at the limit, the job waits for one of busy threads
+}
+
+void BlockingPool::thread_main() noexcept {
+  std::unique_lock lock{m_lock};
+  while (true) {
+    while (m_first) {
+      auto* job = m_first;
+      m_first = job->next;
+      if (!m_first) {
+        m_last = nullptr;
+      }
+      --m_queued;
+
+      lock.unlock();
+      job->run();
+      // NOTE: job is owned by the parked task, it can't be touched after this
+      job->engine->notify(&job->op);
+      lock.lock();
+    }
+
+    if (m_shutdown) {
+      break;
+    }
+
+    ++m_idle;
+    const bool woken = m_wakeup.wait_for(lock, m_config.keep_alive, [this] {
+      return m_first != nullptr || m_shutdown;
+    });
+    --m_idle;
+
+    if (!woken) {
+      // idle for too long
+      break;
+    }
+  }
+
+  --m_threads;
+  m_exited.notify_all();
+}
+
+} // namespace rt
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+
+#include "io_engine.hpp"
+
+
+namespace rt {
+
+namespace detail {
+
+// Lives on the stack of the task which is parked until the job is done
+struct BlockingJob {
+  explicit BlockingJob(Task* task) noexcept : op(task) {}
+  virtual ~BlockingJob() = default;
+  virtual void run() noexcept = 0;
+
+  IoOp op;
+  IoEngine* engine{nullptr};
+  BlockingJob* next{nullptr};
+};
+
+template <typename F, typename T>
+struct BlockingJobImpl : BlockingJob {
+  BlockingJobImpl(Task* task, F& f) noexcept : BlockingJob(task), fn(f) {}
+  void run() noexcept override { value.emplace(fn()); }
+  T take() { return std::move(*value); }
+
+  F& fn;
+  std::optional<T> value;
+};
+
+template <typename F>
+struct BlockingJobImpl<F, void> : BlockingJob {
+  BlockingJobImpl(Task* task, F& f) noexcept : BlockingJob(task), fn(f) {}
+  void run() noexcept override { fn(); }
+  void take() {}
+
+  F& fn;
+};
+
+}  // namespace detail
+
+// Elastic pool of threads for blocking calls and long CPU-bound jobs.
+// Threads are started on demand up to max_threads and exit after being idle
+// for keep_alive.
+class BlockingPool {
+ public:
+  struct Config {
+    std::size_t max_threads{64};
+    std::chrono::milliseconds keep_alive{10'000};
+  };
+
+  explicit BlockingPool(Config config) noexcept : m_config(config) {}
+  BlockingPool(const BlockingPool&) = delete;
+  BlockingPool& operator=(const BlockingPool&) = delete;
+  // waits for all threads to exit
+  ~BlockingPool() noexcept;
+
+  // NOTE: job->engine should be set, completion is posted there
+  void submit(detail::BlockingJob* job) noexcept;
+
+ private:
+  void thread_main() noexcept;
+
+  Config m_config;
+
+  std::mutex m_lock;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_exited;
+  detail::BlockingJob* m_first{nullptr};
+  detail::BlockingJob* m_last{nullptr};
+  std::size_t m_queued{0};
+  std::size_t m_threads{0};
+  std::size_t m_idle{0};
+  bool m_shutdown{false};
+};
+
+} // namespace rt
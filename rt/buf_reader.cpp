@@ -0,0 +1,176 @@
+#include "buf_reader.hpp"
+#include "worker.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace rt {
+
+std::size_t BufReader::tail() const noexcept {
+  const auto tail = m_head + m_size;
+  return tail < m_capacity ? tail : tail - m_capacity;
+}
+
+Result<std::string_view> BufReader::fill_buf() noexcept {
+  if (m_size == 0) {
+    const auto n = fill();
+    if (auto e = n.err()) {
+      return e;
+    }
+  } else {
+    consume_budget();
+  }
+
+  const auto n = (std::min)(m_size, m_capacity - m_head);
+  return std::string_view{m_buffer.get() + m_head, n};
+}
+
+void BufReader::consume(std::size_t n) noexcept {
+  n = (std::min)(n, m_size);
+  m_size -= n;
+  m_head += n;
+  if (m_head >= m_capacity) {
+    m_head -= m_capacity;
+  }
+
+  if (m_size == 0) {
+    // free, keeps the next receive in a single contiguous slice
+    m_head = 0;
+  }
+}
+
+Result<std::size_t> BufReader::fill() noexcept {
+  const auto free = m_capacity - m_size;
+  if (free == 0) {
+    return std::error_code(WSAEMSGSIZE, std::system_category());
+  }
+
+  const auto t = tail();
+  const auto first = (std::min)(free, m_capacity - t);
+  const IoSliceMut slices[2] = {
+      {m_buffer.get() + t, first},
+      {m_buffer.get(), free - first},
+  };
+
+  const auto n = m_stream.recv_vectored(slices, free == first ? 1 : 2);
+  if (auto e = n.err()) {
+    return e;
+  }
+
+  m_size += *n;
+  return *n;
+}
+
+std::string_view BufReader::contiguous() noexcept {
+  if (m_head + m_size > m_capacity) {
+    std::rotate(m_buffer.get(), m_buffer.get() + m_head,
+                m_buffer.get() + m_capacity);
+    m_head = 0;
+  }
+
+  return {m_buffer.get() + m_head, m_size};
+}
+
+Result<std::size_t> BufReader::read(char* data, std::size_t n) noexcept {
+  if (m_size == 0 && n >= m_capacity) {
+    return m_stream.recv(data, n);
+  }
+
+  std::size_t copied = 0;
+  while (copied < n) {
+    auto buf = fill_buf();
+    if (auto e = buf.err()) {
+      return e;
+    }
+
+    if (buf->empty()) {
+      break;
+    }
+
+    const auto k = (std::min)(buf->size(), n - copied);
+    std::memcpy(data + copied, buf->data(), k);
+    consume(k);
+    copied += k;
+
+    // don't block once there is something to return
+    if (m_size == 0) {
+      break;
+    }
+  }
+
+  return copied;
+}
+
+std::error_code BufReader::read_exact(char* data, std::size_t n) noexcept {
+  std::size_t copied = 0;
+  while (copied < n) {
+    const auto r = read(data + copied, n - copied);
+    if (auto e = r.err()) {
+      return e;
+    }
+
+    if (*r == 0) {
+      return std::error_code(ERROR_HANDLE_EOF, std::system_category());
+    }
+
+    copied += *r;
+  }
+
+  return {};
+}
+
+Result<std::string_view> BufReader::read_until(char delim) noexcept {
+  consume_budget();
+  std::size_t scanned = 0;
+  while (true) {
+    // search both halves of the ring, skipping what was already searched
+    const auto first = (std::min)(m_size, m_capacity - m_head);
+    const char* found = nullptr;
+    std::size_t offset = 0;
+    if (scanned < first) {
+      found = static_cast<const char*>(std::memchr(
+          m_buffer.get() + m_head + scanned, delim, first - scanned));
+      if (found) {
+        offset = found - (m_buffer.get() + m_head);
+      }
+    }
+
+    if (!found && m_size > first) {
+      const auto from = scanned > first ? scanned - first : 0;
+      found = static_cast<const char*>(
+          std::memchr(m_buffer.get() + from, delim, m_size - first - from));
+      if (found) {
+        offset = first + (found - m_buffer.get());
+      }
+    }
+
+    if (found) {
+      const auto n = offset + 1;
+      if (m_head + n > m_capacity) {
+        contiguous();
+      }
+
+      const std::string_view frame{m_buffer.get() + m_head, n};
+      // NOTE: consume() may reset m_head, but the data stays in place
+      consume(n);
+      return frame;
+    }
+
+    scanned = m_size;
+    const auto r = fill();
+    if (auto e = r.err()) {
+      return e;
+    }
+
+    if (*r == 0) {
+      if (m_size != 0) {
+        return std::error_code(ERROR_HANDLE_EOF, std::system_category());
+      }
+
+      return std::string_view{};
+    }
+  }
+}
+
+} // namespace rt
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <system_error>
+
+#include "result.hpp"
+#include "stream.hpp"
+
+
+namespace rt {
+
+// Buffered reader over a stream backed by a ring buffer.
+//
+// Every receive fills all free space of the ring (both halves around the wrap
+// point in one scattered recv), so small reads are served from the buffer.
+// Buffered data is never compacted, it is moved only when a single frame
+// requested by read_until() or contiguous() straddles the wrap point.
+//
+// Views returned by the reader point into its buffer and are valid until the
+// next call that receives data (fill_buf(), fill(), read*()).
+class BufReader {
+ public:
+  static constexpr std::size_t DEFAULT_CAPACITY = 16 * 1024;
+
+  // NOTE: buffer is allocated on the heap, tasks have small stacks
+  explicit BufReader(StreamRef s, std::size_t capacity = DEFAULT_CAPACITY)
+      : m_stream(s), m_buffer(new char[capacity]), m_capacity(capacity) {}
+
+  std::size_t buffered() const noexcept { return m_size; }
+  std::size_t capacity() const noexcept { return m_capacity; }
+
+  // returns buffered data up to the wrap point, receives only if the buffer
+  // is empty; empty view means end of stream
+  Result<std::string_view> fill_buf() noexcept;
+  // marks n bytes returned by fill_buf()/contiguous() as read
+  void consume(std::size_t n) noexcept;
+  // receives more data regardless of what is buffered, returns number of
+  // received bytes (0 on end of stream)
+  Result<std::size_t> fill() noexcept;
+  // returns all buffered data, moving it to the start of the buffer if it
+  // wraps around
+  std::string_view contiguous() noexcept;
+
+  // copies up to n bytes, reads larger than the buffer bypass it
+  Result<std::size_t> read(char* data, std::size_t n) noexcept;
+  // fails with ERROR_HANDLE_EOF if stream ends before n bytes are read
+  std::error_code read_exact(char* data, std::size_t n) noexcept;
+  // returns data up to and including delim and consumes it. Returns empty
+  // view on end of stream, fails with ERROR_HANDLE_EOF if stream ends in the
+  // middle of a frame and with WSAEMSGSIZE if the frame doesn't fit into the
+  // buffer.
+  Result<std::string_view> read_until(char delim) noexcept;
+
+ private:
+  std::size_t tail() const noexcept;
+
+  StreamRef m_stream;
+  std::unique_ptr<char[]> m_buffer;
+  std::size_t m_capacity;
+  std::size_t m_head{0};  // position of the first buffered byte
+  std::size_t m_size{0};
+};
+
+} // namespace rt
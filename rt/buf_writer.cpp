@@ -0,0 +1,32 @@
+#include "buf_writer.hpp"
+#include "worker.hpp"
+
+#include <cstring>
+
+
+namespace rt {
+
+std::error_code BufWriter::write(const char* data, std::size_t n) noexcept {
+  if (m_capacity - m_size > n) {
+    std::memcpy(m_buffer.get() + m_size, data, n);
+    m_size += n;
+    consume_budget();
+    return {};
+  }
+
+  IoSlice slices[2] = {{m_buffer.get(), m_size}, {data, n}};
+  m_size = 0;
+  return m_stream.send_all_vectored(slices, 2);
+}
+
+std::error_code BufWriter::flush() noexcept {
+  if (m_size == 0) {
+    return {};
+  }
+
+  const auto n = m_size;
+  m_size = 0;
+  return m_stream.send_all(m_buffer.get(), n);
+}
+
+} // namespace rt
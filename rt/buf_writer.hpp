@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+
+#include "stream.hpp"
+
+
+namespace rt {
+
+// Accumulates small writes (e.g. responses to pipelined requests) and sends
+// them with a single call once the buffer fills up or flush() is called.
+// Nothing is sent implicitly on destruction, call flush() explicitly.
+class BufWriter {
+ public:
+  static constexpr std::size_t DEFAULT_CAPACITY = 16 * 1024;
+
+  // NOTE: buffer is allocated on the heap, tasks have small stacks
+  explicit BufWriter(StreamRef s, std::size_t capacity = DEFAULT_CAPACITY)
+      : m_stream(s), m_buffer(new char[capacity]), m_capacity(capacity) {}
+
+  std::size_t buffered() const noexcept { return m_size; }
+  std::size_t capacity() const noexcept { return m_capacity; }
+
+  // copies data into the buffer if it fits, otherwise sends buffered data
+  // followed by data in a single vectored send without copying data
+  std::error_code write(const char* data, std::size_t n) noexcept;
+  std::error_code flush() noexcept;
+
+ private:
+  StreamRef m_stream;
+  std::unique_ptr<char[]> m_buffer;
+  std::size_t m_capacity;
+  std::size_t m_size{0};
+};
+
+} // namespace rt
@@ -0,0 +1,26 @@
+#include "co_task.hpp"
+
+
+namespace rt::detail {
+
+void* allocate_frame(std::size_t size) {
+  auto* task = current_task();
+  if (!task || !task->owner) {
+    // e.g. a root coroutine created outside of the runtime
+    return FramePool::allocate_unpooled(size);
+  }
+
+  return task->owner->frame_pool()->allocate(size);
+}
+
+void free_frame(void* p, std::size_t size) noexcept {
+  auto* task = current_task();
+  if (!task || !task->owner) {
+    FramePool::deallocate_unpooled(p, size);
+    return;
+  }
+
+  task->owner->frame_pool()->deallocate(p, size);
+}
+
+}  // namespace rt::detail
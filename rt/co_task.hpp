@@ -0,0 +1,317 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <source_location>
+#include <system_error>
+#include <utility>
+
+#include "io_engine.hpp"
+#include "result.hpp"
+#include "socket.hpp"
+#include "task.hpp"
+#include "worker.hpp"
+
+
+namespace rt {
+
+template <typename T>
+class co_task;
+
+namespace detail {
+
+// frames come from the pool of the worker the coroutine is created on
+void* allocate_frame(std::size_t size);
+void free_frame(void* p, std::size_t size) noexcept;
+
+struct CoPromiseBase {
+  static void* operator new(std::size_t size) { return allocate_frame(size); }
+  static void operator delete(void* p, std::size_t size) noexcept { free_frame(p, size); }
+
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      if (auto continuation = h.promise().continuation) {
+        return continuation;
+      }
+
+      // root coroutine of a spawned task, nobody waits for it
+      auto* task = current_task();
+      h.destroy();
+      task->finalize_coroutine();
+      return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  // lazy, runs when awaited or spawned
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+  // NOTE: same as for stackful tasks, exceptions should not escape
+  void unhandled_exception() const noexcept { std::terminate(); }
+
+  std::coroutine_handle<> continuation{};
+};
+
+template <typename T>
+struct CoPromise : CoPromiseBase {
+  co_task<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& v) {
+    value.emplace(std::forward<U>(v));
+  }
+
+  T take() { return std::move(*value); }
+
+  std::optional<T> value;
+};
+
+template <>
+struct CoPromise<void> : CoPromiseBase {
+  co_task<void> get_return_object() noexcept;
+  void return_void() const noexcept {}
+  void take() const noexcept {}
+};
+
+}  // namespace detail
+
+// Stackless task, a C++20 coroutine which runs on the worker's stack and
+// keeps its state in a pooled frame instead of a 32 KiB stack.
+//
+// A co_task either is spawned with rt::spawn() or awaited by another
+// co_task, in which case both run as one Task. Inside of it, use awaitables
+// from rt::co instead of blocking Socket methods and rt::yield().
+template <typename T = void>
+class [[nodiscard]] co_task {
+ public:
+  using promise_type = detail::CoPromise<T>;
+
+  co_task(const co_task&) = delete;
+  co_task(co_task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+  co_task& operator=(const co_task&) = delete;
+  co_task& operator=(co_task&&) = delete;
+  ~co_task() {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+    m_handle.promise().continuation = caller;
+    return m_handle;
+  }
+  T await_resume() { return m_handle.promise().take(); }
+
+  // hands the frame over, it destroys itself when done
+  std::coroutine_handle<promise_type> release() noexcept {
+    return std::exchange(m_handle, {});
+  }
+
+ private:
+  friend promise_type;
+  explicit co_task(std::coroutine_handle<promise_type> h) noexcept : m_handle(h) {}
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+
+template <typename T>
+co_task<T> CoPromise<T>::get_return_object() noexcept {
+  return co_task<T>{std::coroutine_handle<CoPromise<T>>::from_promise(*this)};
+}
+
+inline co_task<void> CoPromise<void>::get_return_object() noexcept {
+  return co_task<void>{std::coroutine_handle<CoPromise<void>>::from_promise(*this)};
+}
+
+// Issues an operation in await_suspend() and parks the task until the worker
+// dequeues its completion.
+// NOTE: awaiters live in the coroutine frame, so op stays in place
+template <typename Op = IoOp>
+struct IoAwaiter {
+  bool await_ready() const noexcept { return false; }
+
+  template <typename Start>
+  bool suspend(std::coroutine_handle<> h, Start&& start) noexcept {
+    auto* task = current_task();
+    op.task = task;
+    error = start(task->owner->io());
+    if (error) {
+      // no completion will be posted, resume right away
+      return false;
+    }
+
+    task->coroutine = h;
+    task->suspend_on_io();
+    return true;
+  }
+
+  Op op{nullptr};
+  std::error_code error{};
+};
+
+struct AcceptAwaiter : IoAwaiter<AcceptOp> {
+  explicit AcceptAwaiter(Socket* l) noexcept : listener(l) {}
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    return suspend(h, [this](IoEngine* io) { return io->start_accept(&op, listener); });
+  }
+
+  Result<Socket> await_resume() noexcept {
+    if (error) {
+      return error;
+    }
+    return current_task()->owner->io()->finish_accept(&op, listener);
+  }
+
+  Socket* listener;
+};
+
+struct ConnectAwaiter : IoAwaiter<> {
+  ConnectAwaiter(IpAddr a, Port p) noexcept : ip(a), port(p) {}
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    return suspend(h, [this](IoEngine* io) {
+      return io->start_connect(&op, &socket, ip, port);
+    });
+  }
+
+  Result<Socket> await_resume() noexcept {
+    if (error) {
+      return error;
+    }
+    return current_task()->owner->io()->finish_connect(&op, &socket);
+  }
+
+  IpAddr ip;
+  Port port;
+  Socket socket{};
+};
+
+struct SendAwaiter : IoAwaiter<> {
+  SendAwaiter(Socket* socket, IoSlice data) noexcept : s(socket), slice(data) {}
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    return suspend(h, [this](IoEngine* io) { return io->start_send(&op, s, &slice, 1); });
+  }
+
+  Result<std::size_t> await_resume() noexcept {
+    if (error) {
+      return error;
+    }
+    return IoEngine::transferred(op);
+  }
+
+  Socket* s;
+  IoSlice slice;
+};
+
+struct RecvAwaiter : IoAwaiter<> {
+  RecvAwaiter(Socket* socket, IoSliceMut data) noexcept : s(socket), slice(data) {}
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    return suspend(h, [this](IoEngine* io) { return io->start_recv(&op, s, &slice, 1); });
+  }
+
+  Result<std::size_t> await_resume() noexcept {
+    if (error) {
+      return error;
+    }
+    return IoEngine::transferred(op);
+  }
+
+  Socket* s;
+  IoSliceMut slice;
+};
+
+struct ShutdownAwaiter : IoAwaiter<> {
+  explicit ShutdownAwaiter(Socket* socket) noexcept : s(socket) {}
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    return suspend(h, [this](IoEngine* io) { return io->start_shutdown(&op, s); });
+  }
+
+  std::error_code await_resume() noexcept {
+    if (error) {
+      return error;
+    }
+    return IoEngine::transferred(op).err();
+  }
+
+  Socket* s;
+};
+
+struct YieldAwaiter {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) noexcept {
+    auto* task = current_task();
+    task->coroutine = h;
+    task->suspend_yield();
+  }
+  void await_resume() const noexcept {}
+};
+
+}  // namespace detail
+
+// Awaitable counterparts of Socket operations and rt::yield() for co_task,
+// e.g. auto n = co_await rt::co::recv(s, buffer, sizeof(buffer));
+namespace co {
+
+inline detail::AcceptAwaiter accept(Socket& listener) noexcept {
+  return detail::AcceptAwaiter{&listener};
+}
+
+inline detail::ConnectAwaiter connect(IpAddr ip, Port port) noexcept {
+  return {ip, port};
+}
+
+inline detail::SendAwaiter send(Socket& s, const char* data, std::size_t n) noexcept {
+  return {&s, IoSlice{data, n}};
+}
+
+inline detail::RecvAwaiter recv(Socket& s, char* data, std::size_t n) noexcept {
+  return {&s, IoSliceMut{data, n}};
+}
+
+inline detail::ShutdownAwaiter shutdown(Socket& s) noexcept {
+  return detail::ShutdownAwaiter{&s};
+}
+
+inline detail::YieldAwaiter yield() noexcept { return {}; }
+
+inline co_task<std::error_code> send_all(Socket& s, const char* data, std::size_t n) {
+  std::size_t sent = 0;
+  while (sent < n) {
+    const auto r = co_await send(s, data + sent, n - sent);
+    if (auto e = r.err()) {
+      co_return e;
+    }
+
+    if (*r == 0) {
+      co_return std::error_code(WSAECONNRESET, std::system_category());
+    }
+
+    sent += *r;
+  }
+
+  co_return std::error_code{};
+}
+
+}  // namespace co
+
+// spawns a stackless task, on the current worker by default
+inline void spawn(co_task<void>&& task, Priority priority = Priority::Normal,
+                  Placement placement = Placement::local(),
+                  std::source_location location = std::source_location::current()) {
+  current_task()->owner->spawn_coroutine(task.release(), priority, placement, location);
+}
+
+}  // namespace rt
@@ -0,0 +1,60 @@
+#include "connection_pool.hpp"
+#include "worker.hpp"
+#include "task.hpp"
+
+
+namespace rt {
+
+// an idle connection should never be readable, if it is then peer either
+// closed it or sent something we didn't ask for
+static bool is_reusable(const Socket& s) noexcept {
+  WSAPOLLFD fd{};
+  fd.fd = reinterpret_cast<SOCKET>(s.handle());
+  fd.events = POLLRDNORM;
+  const int status = ::WSAPoll(&fd, 1, 0);
+  return status == 0;
+}
+
+Result<Socket> ConnectionPool::acquire(IpAddr ip, Port port) noexcept {
+  auto it = m_idle.find(key(ip, port));
+  if (it != m_idle.end()) {
+    auto& idle = it->second;
+    while (!idle.empty()) {
+      // most recently used connection is the least likely to be closed
+      auto s = std::move(idle.back());
+      idle.pop_back();
+      if (is_reusable(s)) {
+        return s;
+      }
+    }
+  }
+
+  return Socket::connect(ip, port);
+}
+
+void ConnectionPool::release(IpAddr ip, Port port, Socket s) noexcept {
+  if (!s.valid()) {
+    return;
+  }
+
+  auto& idle = m_idle[key(ip, port)];
+  if (idle.size() >= MAX_IDLE_PER_ADDR) {
+    return;
+  }
+
+  idle.emplace_back(std::move(s));
+}
+
+std::size_t ConnectionPool::idle() const noexcept {
+  std::size_t n = 0;
+  for (const auto& [_, sockets] : m_idle) {
+    n += sockets.size();
+  }
+  return n;
+}
+
+ConnectionPool& connection_pool() {
+  return *current_task()->owner->connections();
+}
+
+} // namespace rt
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "result.hpp"
+#include "socket.hpp"
+
+
+namespace rt {
+
+// Keep-alive connections owned by a single worker. Connections taken from
+// the pool are already registered with the worker's IoEngine, so reusing
+// them costs neither a handshake nor a registration.
+class ConnectionPool {
+ public:
+  static constexpr std::size_t MAX_IDLE_PER_ADDR = 64;
+
+  ConnectionPool() noexcept = default;
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool(ConnectionPool&&) noexcept = default;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(ConnectionPool&&) noexcept = default;
+  ~ConnectionPool() noexcept = default;
+
+  // returns idle connection to ip:port or establishes a new one
+  // NOTE: peer is free to close idle connection at any moment, connections
+  //       closed while idle are dropped here, but the first request on a
+  //       reused connection can still fail and should be retried
+  Result<Socket> acquire(IpAddr ip, Port port) noexcept;
+  // returns connection to the pool, should be called only if connection is
+  // in a clean state, i.e. there is no unread response left in it
+  void release(IpAddr ip, Port port, Socket s) noexcept;
+
+  std::size_t idle() const noexcept;
+  void clear() noexcept { m_idle.clear(); }
+
+ private:
+  static std::uint64_t key(IpAddr ip, Port port) noexcept {
+    return std::uint64_t{ip[0]} << 40 | std::uint64_t{ip[1]} << 32 |
+           std::uint64_t{ip[2]} << 24 | std::uint64_t{ip[3]} << 16 | port;
+  }
+
+  std::unordered_map<std::uint64_t, std::vector<Socket>> m_idle;
+};
+
+// pool of the worker current task is running on
+ConnectionPool& connection_pool();
+
+} // namespace rt
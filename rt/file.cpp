@@ -0,0 +1,98 @@
+#include "file.hpp"
+#include "worker.hpp"
+#include "task.hpp"
+
+
+namespace rt {
+
+Result<File> File::open(const std::filesystem::path& path, OpenMode mode) noexcept {
+  DWORD access{0};
+  DWORD disposition{0};
+  switch (mode) {
+    case OpenMode::Read:
+      access = GENERIC_READ;
+      disposition = OPEN_EXISTING;
+      break;
+    case OpenMode::Write:
+      access = GENERIC_WRITE;
+      disposition = CREATE_ALWAYS;
+      break;
+    case OpenMode::ReadWrite:
+      access = GENERIC_READ | GENERIC_WRITE;
+      disposition = OPEN_ALWAYS;
+      break;
+  }
+
+  // CreateFile() can't be issued asynchronously
+  return spawn_blocking([&]() -> Result<File> {
+    Handle h = ::CreateFileW(path.c_str(), access,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr, disposition,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+      return last_os_error();
+    }
+
+    return File{h};
+  });
+}
+
+void File::close() noexcept {
+  if (valid()) {
+    CloseHandle(m_handle);
+    m_engine = nullptr;
+    m_handle = INVALID_HANDLE_VALUE;
+  }
+}
+
+Result<std::uint64_t> File::size() const noexcept {
+  LARGE_INTEGER size{};
+  if (!::GetFileSizeEx(m_handle, &size)) {
+    return last_os_error();
+  }
+
+  return static_cast<std::uint64_t>(size.QuadPart);
+}
+
+Result<std::size_t> File::read(std::uint64_t offset, char* data, std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->read(task, this, offset, data, n);
+}
+
+Result<std::size_t> File::write(std::uint64_t offset, const char* data,
+                                std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->write(task, this, offset, data, n);
+}
+
+std::error_code File::write_all(std::uint64_t offset, const char* data,
+                                std::size_t n) noexcept {
+  std::size_t written = 0;
+  while (written < n) {
+    const auto w = write(offset + written, data + written, n - written);
+    if (auto e = w.err()) {
+      return e;
+    }
+
+    if (*w == 0) {
+      return std::error_code(ERROR_HANDLE_EOF, std::system_category());
+    }
+
+    written += *w;
+  }
+
+  return {};
+}
+
+std::error_code File::fsync() noexcept {
+  // there is no overlapped version of FlushFileBuffers()
+  return spawn_blocking([this]() -> std::error_code {
+    if (!::FlushFileBuffers(m_handle)) {
+      return last_os_error();
+    }
+
+    return {};
+  });
+}
+
+} // namespace rt
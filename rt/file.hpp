@@ -0,0 +1,72 @@
+#pragma once
+
+#include "result.hpp"
+#include "handle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+
+namespace rt {
+
+class IoEngine;
+struct Task;
+
+enum class OpenMode {
+  Read,       // existing file, read only
+  Write,      // create or truncate, write only
+  ReadWrite,  // create if missing, read and write
+};
+
+class File {
+ public:
+  friend class IoEngine;
+
+  File() = default;
+  File(Handle h) noexcept : m_handle(h) {}
+  File(const File&) = delete;
+  File(File&& other) noexcept
+      : m_engine(other.m_engine),
+        m_handle{other.m_handle} {
+    other.m_engine = nullptr;
+    other.m_handle = INVALID_HANDLE_VALUE;
+  }
+  File& operator=(const File&) = delete;
+  File& operator=(File&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+
+    close();
+    std::swap(m_engine, other.m_engine);
+    std::swap(m_handle, other.m_handle);
+    return *this;
+  }
+  ~File() noexcept { close(); }
+
+  // NOTE: CreateFile can't be issued asynchronously, so open() is executed
+  //       on the blocking pool while the calling task is parked
+  static Result<File> open(const std::filesystem::path& path,
+                           OpenMode mode = OpenMode::Read) noexcept;
+
+  bool valid() const noexcept { return m_handle != INVALID_HANDLE_VALUE; }
+  void close() noexcept;
+  Handle handle() const noexcept { return m_handle; }
+
+  Result<std::uint64_t> size() const noexcept;
+
+  // returns 0 on end of file
+  Result<std::size_t> read(std::uint64_t offset, char* data, std::size_t n) noexcept;
+  Result<std::size_t> write(std::uint64_t offset, const char* data, std::size_t n) noexcept;
+  std::error_code write_all(std::uint64_t offset, const char* data, std::size_t n) noexcept;
+  // executed on the blocking pool, same as open()
+  std::error_code fsync() noexcept;
+
+ private:
+  IoEngine* m_engine{nullptr};
+  Handle m_handle{INVALID_HANDLE_VALUE};
+};
+
+
+} // namespace rt
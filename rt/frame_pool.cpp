@@ -0,0 +1,61 @@
+#include "frame_pool.hpp"
+
+#include <new>
+
+
+namespace rt {
+
+static std::size_t rounded(std::size_t size) noexcept {
+  return (size + FramePool::GRANULARITY - 1) & ~(FramePool::GRANULARITY - 1);
+}
+
+FramePool::~FramePool() noexcept {
+  for (auto* frame : m_free) {
+    while (frame) {
+      auto* next = frame->next;
+      ::operator delete(frame);
+      frame = next;
+    }
+  }
+}
+
+void* FramePool::allocate(std::size_t size) {
+  size = rounded(size);
+  if (size > MAX_POOLED) {
+    return ::operator new(size);
+  }
+
+  const auto cls = size / GRANULARITY - 1;
+  if (auto* frame = m_free[cls]) {
+    m_free[cls] = frame->next;
+    --m_cached[cls];
+    return frame;
+  }
+
+  return ::operator new(size);
+}
+
+void FramePool::deallocate(void* p, std::size_t size) noexcept {
+  size = rounded(size);
+  const auto cls = size / GRANULARITY - 1;
+  if (size > MAX_POOLED || m_cached[cls] >= MAX_CACHED) {
+    ::operator delete(p);
+    return;
+  }
+
+  auto* frame = static_cast<FreeFrame*>(p);
+  frame->next = m_free[cls];
+  m_free[cls] = frame;
+  ++m_cached[cls];
+}
+
+void* FramePool::allocate_unpooled(std::size_t size) {
+  // NOTE: rounded, since it can be freed to a pool later
+  return ::operator new(rounded(size));
+}
+
+void FramePool::deallocate_unpooled(void* p, std::size_t) noexcept {
+  ::operator delete(p);
+}
+
+} // namespace rt
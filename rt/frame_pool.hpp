@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+
+namespace rt {
+
+// Per-worker cache of coroutine frames, sizes are rounded up to a multiple
+// of 64 bytes and each size class has its own free list. Only the owning
+// worker thread touches it, a frame can be freed to a different pool than
+// the one it came from.
+class FramePool {
+ public:
+  static constexpr std::size_t GRANULARITY = 64;
+  static constexpr std::size_t MAX_POOLED = 2048;  // larger frames aren't cached
+  static constexpr std::size_t MAX_CACHED = 1024;  // per size class
+
+  FramePool() noexcept = default;
+  FramePool(const FramePool&) = delete;
+  FramePool(FramePool&& other) noexcept : m_free(other.m_free), m_cached(other.m_cached) {
+    other.m_free.fill(nullptr);
+    other.m_cached.fill(0);
+  }
+  FramePool& operator=(const FramePool&) = delete;
+  FramePool& operator=(FramePool&&) = delete;
+  ~FramePool() noexcept;
+
+  void* allocate(std::size_t size);
+  void deallocate(void* p, std::size_t size) noexcept;
+
+  // used when there is no current worker
+  static void* allocate_unpooled(std::size_t size);
+  static void deallocate_unpooled(void* p, std::size_t size) noexcept;
+
+ private:
+  struct FreeFrame {
+    FreeFrame* next;
+  };
+
+  static constexpr std::size_t N_CLASSES = MAX_POOLED / GRANULARITY;
+
+  std::array<FreeFrame*, N_CLASSES> m_free{};
+  std::array<std::size_t, N_CLASSES> m_cached{};
+};
+
+} // namespace rt
@@ -0,0 +1,414 @@
+#include "http_parser.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include <immintrin.h>
+
+
+namespace rt {
+
+static char to_lower(char c) noexcept {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static bool equals_ci(std::string_view a, std::string_view b) noexcept {
+  if (a.size() != b.size()) {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (to_lower(a[i]) != to_lower(b[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static std::string_view trim(std::string_view s) noexcept {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+
+  return s;
+}
+
+// calls fn for every element of comma separated list
+template <typename F>
+static void for_each_token(std::string_view list, F&& fn) {
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    fn(trim(list.substr(0, comma)));
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma + 1);
+  }
+}
+
+static bool is_token(std::string_view s) noexcept {
+  if (s.empty()) {
+    return false;
+  }
+
+  for (char c : s) {
+    // control characters, space and separators (except for the most common
+    // ones in methods and header names)
+    if (c <= ' ' || c >= 127 || c == ':' || c == '"' || c == '(' || c == ')' ||
+        c == ',' || c == '/' || c == ';' || c == '<' || c == '=' || c == '>' ||
+        c == '?' || c == '@' || c == '[' || c == '\\' || c == ']' || c == '{' ||
+        c == '}') {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns offset right after the first "\r\n\r\n" which starts in
+// [data + from, data + n), or 0 if there is none.
+// Compares 4 shifted loads at once, so every match is exact and there are no
+// false candidates to verify on '\r' of every header line.
+static std::size_t find_head_end(const char* data, std::size_t from,
+                                 std::size_t n) noexcept {
+  const char* p = data + from;
+  const char* end = data + n;
+
+#if defined(__AVX2__)
+  {
+    const auto cr = _mm256_set1_epi8('\r');
+    const auto lf = _mm256_set1_epi8('\n');
+    while (end - p >= 32 + 3) {
+      const auto load = [p](std::size_t off) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + off));
+      };
+      const auto crlf0 = _mm256_and_si256(_mm256_cmpeq_epi8(load(0), cr),
+                                          _mm256_cmpeq_epi8(load(1), lf));
+      const auto crlf1 = _mm256_and_si256(_mm256_cmpeq_epi8(load(2), cr),
+                                          _mm256_cmpeq_epi8(load(3), lf));
+      const auto mask = static_cast<std::uint32_t>(
+          _mm256_movemask_epi8(_mm256_and_si256(crlf0, crlf1)));
+      if (mask) {
+        return static_cast<std::size_t>(p - data) + std::countr_zero(mask) + 4;
+      }
+      p += 32;
+    }
+  }
+#endif
+
+  {
+    // SSE2 is always available on x64
+    const auto cr = _mm_set1_epi8('\r');
+    const auto lf = _mm_set1_epi8('\n');
+    while (end - p >= 16 + 3) {
+      const auto load = [p](std::size_t off) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + off));
+      };
+      const auto crlf0 = _mm_and_si128(_mm_cmpeq_epi8(load(0), cr),
+                                       _mm_cmpeq_epi8(load(1), lf));
+      const auto crlf1 = _mm_and_si128(_mm_cmpeq_epi8(load(2), cr),
+                                       _mm_cmpeq_epi8(load(3), lf));
+      const auto mask = static_cast<std::uint32_t>(
+          _mm_movemask_epi8(_mm_and_si128(crlf0, crlf1)));
+      if (mask) {
+        return static_cast<std::size_t>(p - data) + std::countr_zero(mask) + 4;
+      }
+      p += 16;
+    }
+  }
+
+  for (; end - p >= 4; ++p) {
+    if (p[0] == '\r' && p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+      return static_cast<std::size_t>(p - data) + 4;
+    }
+  }
+
+  return 0;
+}
+
+// returns pointer to '\r' of "\r\n" in [p, end) or nullptr
+static const char* find_line_end(const char* p, const char* end) noexcept {
+  const auto* cr = static_cast<const char*>(std::memchr(p, '\r', end - p));
+  if (!cr || cr + 1 >= end || cr[1] != '\n') {
+    return nullptr;
+  }
+  return cr;
+}
+
+std::string_view HttpRequest::header(std::string_view name) const noexcept {
+  for (std::size_t i = 0; i < n_headers; ++i) {
+    if (equals_ci(headers[i].name, name)) {
+      return headers[i].value;
+    }
+  }
+
+  return {};
+}
+
+bool HttpParser::parse_head(const char* data, HttpRequest& request,
+                            std::size_t& content_length) noexcept {
+  const char* p = data;
+  // end of the last header line, i.e. start of the empty line
+  const char* end = data + m_head_size - 2;
+
+  // request line: method SP target SP HTTP/1.x
+  const char* line_end = find_line_end(p, end + 2);
+  if (!line_end) {
+    return false;
+  }
+
+  const std::string_view line{p, static_cast<std::size_t>(line_end - p)};
+  const auto sp1 = line.find(' ');
+  const auto sp2 = line.find(' ', sp1 + 1);
+  if (sp1 == std::string_view::npos || sp2 == std::string_view::npos) {
+    return false;
+  }
+
+  request.method = line.substr(0, sp1);
+  request.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  const auto version = line.substr(sp2 + 1);
+  if (!is_token(request.method) || request.target.empty() ||
+      version.size() != 8 || version.substr(0, 7) != "HTTP/1." ||
+      (version[7] != '0' && version[7] != '1')) {
+    return false;
+  }
+  request.version_minor = version[7] - '0';
+  request.keep_alive = request.version_minor == 1;
+  request.chunked = false;
+  request.n_headers = 0;
+
+  bool has_length = false;
+  content_length = 0;
+  p = line_end + 2;
+  while (p < end) {
+    line_end = find_line_end(p, end + 2);
+    if (!line_end || p[0] == ' ' || p[0] == '\t') {
+      // NOTE: obsolete line folding is rejected
+      return false;
+    }
+
+    const auto* colon = static_cast<const char*>(std::memchr(p, ':', line_end - p));
+    if (!colon || request.n_headers == HttpRequest::MAX_HEADERS) {
+      return false;
+    }
+
+    auto& header = request.headers[request.n_headers++];
+    header.name = {p, static_cast<std::size_t>(colon - p)};
+    header.value = trim({colon + 1, static_cast<std::size_t>(line_end - colon - 1)});
+    if (!is_token(header.name)) {
+      return false;
+    }
+
+    if (equals_ci(header.name, "Content-Length")) {
+      std::size_t length = 0;
+      if (header.value.empty() || header.value.size() > 15) {
+        return false;
+      }
+
+      for (char c : header.value) {
+        if (c < '0' || c > '9') {
+          return false;
+        }
+        length = length * 10 + static_cast<std::size_t>(c - '0');
+      }
+
+      if (has_length && length != content_length) {
+        return false;
+      }
+      has_length = true;
+      content_length = length;
+    } else if (equals_ci(header.name, "Transfer-Encoding")) {
+      // chunked should be the last transfer coding
+      bool chunked = false;
+      for_each_token(header.value, [&](std::string_view coding) {
+        chunked = equals_ci(coding, "chunked");
+      });
+      if (!chunked) {
+        return false;
+      }
+      request.chunked = true;
+    } else if (equals_ci(header.name, "Connection")) {
+      for_each_token(header.value, [&](std::string_view option) {
+        if (equals_ci(option, "close")) {
+          request.keep_alive = false;
+        } else if (equals_ci(option, "keep-alive")) {
+          request.keep_alive = true;
+        }
+      });
+    }
+
+    p = line_end + 2;
+  }
+
+  // both are present in request smuggling attempts
+  return !(has_length && request.chunked);
+}
+
+ParseStatus HttpParser::scan_chunks(const char* data, std::size_t n) noexcept {
+  constexpr std::size_t max_chunk_line = 1024;
+  constexpr std::size_t max_chunk_size = std::size_t{1} << 40;
+
+  auto pos = m_chunk_pos;
+  while (true) {
+    const char* line = data + pos;
+    const char* line_end = find_line_end(line, data + n);
+    if (!line_end) {
+      return n - pos > max_chunk_line ? ParseStatus::Error : ParseStatus::Incomplete;
+    }
+
+    std::size_t size = 0;
+    const char* p = line;
+    for (; p < line_end && *p != ';'; ++p) {
+      const char c = to_lower(*p);
+      std::size_t digit = 0;
+      if (c >= '0' && c <= '9') {
+        digit = static_cast<std::size_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        digit = static_cast<std::size_t>(c - 'a' + 10);
+      } else {
+        return ParseStatus::Error;
+      }
+
+      size = size * 16 + digit;
+      if (size > max_chunk_size) {
+        return ParseStatus::Error;
+      }
+    }
+
+    if (p == line) {
+      return ParseStatus::Error;
+    }
+
+    const auto data_start = static_cast<std::size_t>(line_end - data) + 2;
+    if (size == 0) {
+      // last chunk, followed either by an empty line or by trailer fields
+      if (n - data_start < 2) {
+        return ParseStatus::Incomplete;
+      }
+
+      std::size_t end = 0;
+      if (data[data_start] == '\r' && data[data_start + 1] == '\n') {
+        end = data_start + 2;
+      } else {
+        end = find_head_end(data, data_start, n);
+        if (end == 0) {
+          return ParseStatus::Incomplete;
+        }
+      }
+
+      m_body_size = end - m_head_size;
+      return ParseStatus::Complete;
+    }
+
+    const auto next = data_start + size + 2;
+    if (next > n) {
+      return ParseStatus::Incomplete;
+    }
+
+    if (data[next - 2] != '\r' || data[next - 1] != '\n') {
+      return ParseStatus::Error;
+    }
+
+    pos = next;
+    m_chunk_pos = pos;
+  }
+}
+
+ParseStatus HttpParser::parse(const char* data, std::size_t n,
+                              HttpRequest& request) noexcept {
+  bool parsed = false;
+  if (m_head_size == 0) {
+    // empty lines before request line should be ignored (RFC 9112, 2.2),
+    // positions below are relative to the first byte after them
+    const auto skipped = m_skipped;
+    while (n - m_skipped >= 2 && data[m_skipped] == '\r' && data[m_skipped + 1] == '\n') {
+      m_skipped += 2;
+    }
+    if (m_skipped != skipped) {
+      m_scanned = 0;
+    }
+    if (m_skipped > MAX_HEAD_SIZE) {
+      return ParseStatus::Error;
+    }
+  }
+
+  const char* head = data + m_skipped;
+  n -= m_skipped;
+  if (m_head_size == 0) {
+    // "\r\n\r\n" could start in the last 3 bytes of previous scan
+    const auto from = m_scanned >= 3 ? m_scanned - 3 : 0;
+    m_head_size = find_head_end(head, from, n);
+    if (m_head_size == 0) {
+      m_scanned = n;
+      return n > MAX_HEAD_SIZE ? ParseStatus::Error : ParseStatus::Incomplete;
+    }
+
+    std::size_t content_length = 0;
+    if (m_head_size > MAX_HEAD_SIZE || !parse_head(head, request, content_length)) {
+      return ParseStatus::Error;
+    }
+
+    parsed = true;
+    m_body = request.chunked ? Body::Chunked
+             : content_length ? Body::Length
+                              : Body::None;
+    m_body_size = content_length;
+    m_chunk_pos = m_head_size;
+  }
+
+  if (m_body == Body::Chunked) {
+    const auto status = scan_chunks(head, n);
+    if (status != ParseStatus::Complete) {
+      return status;
+    }
+  } else if (m_head_size + m_body_size > n) {
+    return ParseStatus::Incomplete;
+  }
+
+  // views from the first parse_head() call could be invalidated by now
+  std::size_t ignore = 0;
+  if (!parsed && !parse_head(head, request, ignore)) {
+    return ParseStatus::Error;
+  }
+
+  request.body = {head + m_head_size, m_body_size};
+  const auto consumed = m_skipped + m_head_size + m_body_size;
+  reset();
+  m_consumed = consumed;
+  return ParseStatus::Complete;
+}
+
+std::size_t decode_chunked(char* body, std::size_t n) noexcept {
+  std::size_t in = 0;
+  std::size_t out = 0;
+  while (in < n) {
+    std::size_t size = 0;
+    while (in < n && body[in] != '\r' && body[in] != ';') {
+      const char c = to_lower(body[in++]);
+      size = size * 16 + static_cast<std::size_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+
+    // skip extensions and "\r\n"
+    while (in < n && body[in] != '\n') {
+      ++in;
+    }
+    ++in;
+
+    if (size == 0 || in + size > n) {
+      break;
+    }
+
+    std::memmove(body + out, body + in, size);
+    out += size;
+    in += size + 2;
+  }
+
+  return out;
+}
+
+} // namespace rt
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+namespace rt {
+
+struct HttpHeader {
+  std::string_view name;
+  std::string_view value;
+};
+
+// All views point into the buffer passed to HttpParser::parse(), they are
+// valid until that buffer is modified
+struct HttpRequest {
+  static constexpr std::size_t MAX_HEADERS = 64;
+
+  std::string_view method;
+  std::string_view target;
+  int version_minor{1};  // HTTP/1.x
+  HttpHeader headers[MAX_HEADERS];
+  std::size_t n_headers{0};
+  // raw body, still chunk-encoded if chunked is set (see decode_chunked())
+  std::string_view body;
+  bool chunked{false};
+  bool keep_alive{true};
+
+  // case-insensitive lookup, returns empty view if there is no such header
+  std::string_view header(std::string_view name) const noexcept;
+};
+
+enum class ParseStatus {
+  Complete,
+  Incomplete,
+  Error,
+};
+
+// Zero-copy HTTP/1.1 request parser.
+//
+// parse() should be called with the buffer starting at the first byte of
+// unparsed request. If it returns Incomplete, the next call (with the same
+// data followed by newly received bytes, the buffer itself may be moved)
+// continues from where the previous one stopped instead of rescanning. On
+// Complete, consumed() bytes belong to the request and the next pipelined
+// request (if any) starts right after them.
+class HttpParser {
+ public:
+  static constexpr std::size_t MAX_HEAD_SIZE = 64 * 1024;
+
+  ParseStatus parse(const char* data, std::size_t n, HttpRequest& request) noexcept;
+  std::size_t consumed() const noexcept { return m_consumed; }
+  void reset() noexcept { *this = HttpParser{}; }
+
+ private:
+  enum class Body {
+    None,
+    Length,
+    Chunked,
+  };
+
+  bool parse_head(const char* data, HttpRequest& request,
+                  std::size_t& content_length) noexcept;
+  ParseStatus scan_chunks(const char* data, std::size_t n) noexcept;
+
+  std::size_t m_skipped{0};     // empty lines before the request line
+  std::size_t m_scanned{0};     // bytes already searched for end of head
+  std::size_t m_head_size{0};   // 0 until end of head is found
+  Body m_body{Body::None};
+  std::size_t m_body_size{0};   // Content-Length or size of chunked body
+  std::size_t m_chunk_pos{0};   // start of the next chunk to scan
+  std::size_t m_consumed{0};
+};
+
+// Decodes chunked body (as validated by HttpParser) in place, returns size of
+// decoded data at the start of body
+std::size_t decode_chunked(char* body, std::size_t n) noexcept;
+
+} // namespace rt
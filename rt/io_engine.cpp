@@ -1,18 +1,9 @@
 #include "io_engine.hpp"
+#include "select.hpp"
 #include "task.hpp"
 
 #include <mswsock.h>
 
-#include <iostream>
-
-#if 0
-#define TRACE_BLOCK                                                    \
-  std::cout << __func__ << ": blocking task " << (void*)task << " on " \
-            << (void*)&overlapped << std::endl
-#else
-#define TRACE_BLOCK
-#endif
-
 extern "C" {
 struct IO_STATUS_BLOCK {
   void* status{nullptr};
@@ -40,11 +31,21 @@ static std::error_code last_socket_error() {
   return socket_error(::WSAGetLastError());
 }
 
+// NOTE: not defined in windows.h
+static constexpr ULONG_PTR STATUS_END_OF_FILE_ = 0xC0000011;
+static constexpr ULONG_PTR STATUS_BUFFER_OVERFLOW_ = 0x80000005;
+
+static DWORD clamp_len(std::size_t n) {
+  constexpr std::size_t max_len = 0xffffffff;
+  return static_cast<DWORD>((std::min)(n, max_len));
+}
+
 static LPFN_DISCONNECTEX DisconnectEx = nullptr;
+static LPFN_CONNECTEX ConnectEx = nullptr;
 
-static LPFN_DISCONNECTEX get_disconnect_fn(SOCKET s) {
-  LPFN_DISCONNECTEX fn = nullptr;
-  GUID guid = WSAID_DISCONNECTEX;
+template <typename Fn>
+static Fn get_extension_fn(SOCKET s, GUID guid) {
+  Fn fn = nullptr;
   DWORD bytes = 0;
   WSAIoctl(s, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &fn,
            sizeof(fn), &bytes, NULL, NULL);
@@ -60,7 +61,8 @@ static void init_sockets() {
       if (!status) {
         SOCKET dummy = ::WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0,
                                    WSA_FLAG_OVERLAPPED);
-        DisconnectEx = get_disconnect_fn(dummy);
+        DisconnectEx = get_extension_fn<LPFN_DISCONNECTEX>(dummy, WSAID_DISCONNECTEX);
+        ConnectEx = get_extension_fn<LPFN_CONNECTEX>(dummy, WSAID_CONNECTEX);
         closesocket(dummy);
       }
     }
@@ -73,7 +75,8 @@ static void init_sockets() {
   return;
 }
 
-IoEngine::IoEngine(Handle h) noexcept : m_iocp{h} { }
+IoEngine::IoEngine(Handle h) noexcept
+    : m_iocp{h}, m_local{std::make_unique<detail::LocalCompletions>()} {}
 
 Result<IoEngine> IoEngine::create() noexcept {
   Handle h = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, 1);
@@ -91,9 +94,9 @@ Result<IoEngine> IoEngine::share() noexcept {
   return create();
 }
 
-std::error_code IoEngine::add(Handle h, void* context) noexcept {
-  const auto key = reinterpret_cast<ULONG_PTR>(context);
-  const auto status = ::CreateIoCompletionPort(h, m_iocp.get(), key, 0);
+std::error_code IoEngine::add(Handle h) noexcept {
+  // NOTE: completion key is not used, the task is found through IoOp
+  const auto status = ::CreateIoCompletionPort(h, m_iocp.get(), 0, 0);
   if (!status) {
     return last_os_error();
   }
@@ -110,8 +113,9 @@ std::error_code IoEngine::remove(Handle h) noexcept {
   return {}; // FIXME: check error
 }
 
-std::error_code IoEngine::lazy_register(Task* task, Socket* s) noexcept {
-  if (s->m_engine == this && s->m_task == task) {
+template <typename T>
+std::error_code IoEngine::lazy_register(T* s) noexcept {
+  if (s->m_engine == this) {
     // should be most common case
     return {};
   }
@@ -120,82 +124,448 @@ std::error_code IoEngine::lazy_register(Task* task, Socket* s) noexcept {
     s->m_engine->remove(s->handle());
   }
 
-  if (auto e = add(s->handle(), task)) {
-    s->m_task = nullptr;
+  if (auto e = add(s->handle())) {
     s->m_engine = nullptr;
     return e;
   }
 
-  s->m_task = task;
   s->m_engine = this;
   return {};
 }
 
-Result<Socket> IoEngine::accept(Task* task, Socket* s) noexcept {
-  if (auto e = lazy_register(task, s)) {
+Result<std::size_t> IoEngine::transferred(const IoOp& op) noexcept {
+  assert(op.Internal != STATUS_PENDING);
+  if (op.Internal != 0) {
+    // FIXME: this is probably not a valid way to pass an error
+    return socket_error(static_cast<DWORD>(op.Internal));
+  }
+
+  return std::size_t{op.InternalHigh};
+}
+
+std::error_code IoEngine::start_accept(AcceptOp* op, Socket* s) noexcept {
+  if (auto e = lazy_register(s)) {
     return e;
   }
 
-  auto client = Socket::create();
+  auto client = Socket::create(s->m_family == AF_UNIX ? Protocol::Unix : Protocol::Tcp);
   if (auto e = client.err()) {
     return e;
   }
+  op->client = std::move(*client);
 
-  struct AddressBuf {
-    sockaddr_in addr;
-    char pad[16];
-  };
-  AddressBuf addresses[2];
-  OVERLAPPED overlapped{};
-  // overlapped.hEvent = h_event;
+  constexpr DWORD address_len = sizeof(op->addresses) / 2;
   DWORD received{0};
-  if (!::AcceptEx(s->m_socket, client->m_socket, &addresses, 0, sizeof(AddressBuf),
-                  sizeof(AddressBuf), &received, &overlapped)) {
+  if (!::AcceptEx(s->m_socket, op->client.m_socket, op->addresses, 0,
+                  address_len, address_len, &received, op)) {
     auto err = last_socket_error();
     if (err.value() != ERROR_IO_PENDING) {
       return err;
     }
   }
 
-  TRACE_BLOCK;
-  task->block_on_io();
-  assert(overlapped.Internal != STATUS_PENDING);
-  if (overlapped.Internal != 0) {
-    // FIXME: this is probably not a valid way to pass an error
-    return socket_error(static_cast<DWORD>(overlapped.Internal));
+  return {};
+}
+
+Result<Socket> IoEngine::finish_accept(AcceptOp* op, Socket* s) noexcept {
+  if (auto e = transferred(*op).err()) {
+    return e;
   }
 
-  if (::setsockopt(client->m_socket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
+  if (::setsockopt(op->client.m_socket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
                    reinterpret_cast<char*>(&s->m_socket), sizeof(s->m_socket)) != 0) {
     return last_socket_error();
   }
 
-  return client;
+  return std::move(op->client);
+}
+
+Result<Socket> IoEngine::accept(Task* task, Socket* s) noexcept {
+  AcceptOp op{task};
+  if (auto e = start_accept(&op, s)) {
+    return e;
+  }
+
+  task->block_on_io();
+  return finish_accept(&op, s);
+}
+
+std::error_code IoEngine::start_connect(IoOp* op, Socket* s, IpAddr ip,
+                                        Port port) noexcept {
+  auto created = Socket::create();
+  if (auto e = created.err()) {
+    return e;
+  }
+  *s = std::move(*created);
+
+  // ConnectEx() works only with bound sockets
+  const auto local = detail::to_sockaddr({0, 0, 0, 0}, 0);
+  if (::bind(s->m_socket, reinterpret_cast<const sockaddr*>(&local),
+             sizeof(local)) != 0) {
+    return last_socket_error();
+  }
+
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  const auto addr = detail::to_sockaddr(ip, port);
+  if (!ConnectEx(s->m_socket, reinterpret_cast<const sockaddr*>(&addr),
+                 sizeof(addr), nullptr, 0, nullptr, op)) {
+    auto err = last_socket_error();
+    if (err.value() != ERROR_IO_PENDING) {
+      return err;
+    }
+  }
+
+  return {};
+}
+
+Result<Socket> IoEngine::finish_connect(IoOp* op, Socket* s) noexcept {
+  if (auto e = transferred(*op).err()) {
+    return e;
+  }
+
+  if (::setsockopt(s->m_socket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, nullptr,
+                   0) != 0) {
+    return last_socket_error();
+  }
+
+  return std::move(*s);
+}
+
+Result<Socket> IoEngine::connect(Task* task, IpAddr ip, Port port) noexcept {
+  Socket s;
+  IoOp op{task};
+  if (auto e = start_connect(&op, &s, ip, port)) {
+    return e;
+  }
+
+  task->block_on_io();
+  return finish_connect(&op, &s);
 }
 
 Result<std::size_t> IoEngine::send(Task* task, Socket* s, const char* data,
                                    std::size_t n) noexcept {
-  if (auto e = lazy_register(task, s)) {
+  const IoSlice slice{data, n};
+  return send_vectored(task, s, &slice, 1);
+}
+
+std::error_code IoEngine::start_send(IoOp* op, Socket* s, const IoSlice* slices,
+                                     std::size_t n) noexcept {
+  if (auto e = lazy_register(s)) {
     return e;
   }
 
-  WSABUF buffer;
-  buffer.buf = const_cast<char*>(data);
-  buffer.len = static_cast<ULONG>(n);
+  constexpr std::size_t max_slices = 16;
+  WSABUF buffers[max_slices];
+  const auto count = (std::min)(n, max_slices);
+  for (std::size_t i = 0; i < count; ++i) {
+    buffers[i].buf = const_cast<char*>(slices[i].data);
+    buffers[i].len = clamp_len(slices[i].size);
+  }
 
   DWORD sent = 0;
   DWORD flags = 0;
-  WSAOVERLAPPED overlapped{};
 
-  if (::WSASend(s->m_socket, &buffer, 1, &sent, flags, &overlapped, nullptr) !=
-      0) {
+  if (::WSASend(s->m_socket, buffers, static_cast<DWORD>(count), &sent, flags,
+                op, nullptr) != 0) {
+    auto err = last_socket_error();
+    if (err.value() != ERROR_IO_PENDING) {
+      return err;
+    }
+  }
+
+  return {};
+}
+
+Result<std::size_t> IoEngine::send_vectored(Task* task, Socket* s,
+                                            const IoSlice* slices,
+                                            std::size_t n) noexcept {
+  IoOp op{task};
+  if (auto e = start_send(&op, s, slices, n)) {
+    return e;
+  }
+
+  task->block_on_io();
+  return transferred(op);
+}
+
+Result<std::size_t> IoEngine::recv(Task* task, Socket* s, char* data,
+                                   std::size_t n) noexcept {
+  const IoSliceMut slice{data, n};
+  return recv_vectored(task, s, &slice, 1);
+}
+
+std::error_code IoEngine::start_recv(IoOp* op, Socket* s,
+                                     const IoSliceMut* slices,
+                                     std::size_t n) noexcept {
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  constexpr std::size_t max_slices = 16;
+  WSABUF buffers[max_slices];
+  const auto count = (std::min)(n, max_slices);
+  for (std::size_t i = 0; i < count; ++i) {
+    buffers[i].buf = slices[i].data;
+    buffers[i].len = clamp_len(slices[i].size);
+  }
+
+  DWORD received{0};
+  DWORD flags{0};
+
+  if (::WSARecv(s->m_socket, buffers, static_cast<DWORD>(count), &received,
+                &flags, op, nullptr) != 0) {
+    auto err = last_socket_error();
+    if (err.value() != ERROR_IO_PENDING) {
+      return err;
+    }
+  }
+
+  return {};
+}
+
+Result<std::size_t> IoEngine::recv_vectored(Task* task, Socket* s,
+                                            const IoSliceMut* slices,
+                                            std::size_t n) noexcept {
+  IoOp op{task};
+  if (auto e = start_recv(&op, s, slices, n)) {
+    return e;
+  }
+
+  task->block_on_io();
+  return transferred(op);
+}
+
+std::error_code IoEngine::start_shutdown(IoOp* op, Socket* s) noexcept {
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  DWORD flags = 0;
+  DWORD reserved = 0;
+
+  if (!DisconnectEx(s->m_socket, op, flags, reserved)) {
+    auto err = last_socket_error();
+    if (err.value() != ERROR_IO_PENDING) {
+      return err;
+    }
+  }
+
+  return {};
+}
+
+std::error_code IoEngine::shutdown(Task* task, Socket* s) noexcept {
+  IoOp op{task};
+  if (auto e = start_shutdown(&op, s)) {
+    return e;
+  }
+
+  task->block_on_io();
+  return transferred(op).err();
+}
+
+// NOTE: max UDP payload size over IPv4
+static constexpr std::size_t max_datagram = 65507;
+
+// receives datagrams that are already queued without blocking, relies on
+// datagram sockets being in non-blocking mode
+static std::error_code recv_queued(SOCKET s, Datagram* msgs, std::size_t n,
+                                   std::size_t& received) {
+  while (received < n) {
+    auto& msg = msgs[received];
+    sockaddr_in from{};
+    int from_len = sizeof(from);
+    const int len = ::recvfrom(s, msg.data, static_cast<int>((std::min)(msg.capacity, max_datagram)), 0,
+                               reinterpret_cast<sockaddr*>(&from), &from_len);
+    if (len == SOCKET_ERROR) {
+      const auto err = ::WSAGetLastError();
+      if (err == WSAEWOULDBLOCK) {
+        return {};
+      }
+
+      if (err != WSAEMSGSIZE) {
+        return socket_error(err);
+      }
+
+      msg.size = (std::min)(msg.capacity, max_datagram);
+      msg.truncated = true;
+    } else {
+      msg.size = static_cast<std::size_t>(len);
+      msg.truncated = false;
+    }
+
+    detail::from_sockaddr(from, msg.ip, msg.port);
+    ++received;
+  }
+
+  return {};
+}
+
+Result<std::size_t> IoEngine::recv_batch(Task* task, Socket* s, Datagram* msgs,
+                                         std::size_t n) noexcept {
+  if (n == 0) {
+    return std::size_t{0};
+  }
+
+  if (s->m_recv_error) {
+    return std::exchange(s->m_recv_error, {});
+  }
+
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  std::size_t received = 0;
+  const auto e = recv_queued(s->m_socket, msgs, n, received);
+  if (received != 0) {
+    task->consume_budget();
+    // error (if any) will be reported by the next call
+    s->m_recv_error = e;
+    return received;
+  }
+
+  if (e) {
+    return e;
+  }
+
+  // nothing is queued, park until the first datagram arrives
+  auto& msg = msgs[0];
+  WSABUF buffer;
+  buffer.buf = msg.data;
+  buffer.len = clamp_len(msg.capacity);
+
+  sockaddr_in from{};
+  int from_len = sizeof(from);
+  DWORD flags{0};
+  IoOp overlapped{task};
+
+  if (::WSARecvFrom(s->m_socket, &buffer, 1, nullptr, &flags,
+                    reinterpret_cast<sockaddr*>(&from), &from_len, &overlapped,
+                    nullptr) != 0) {
+    auto err = last_socket_error();
+    if (err.value() != ERROR_IO_PENDING) {
+      return err;
+    }
+  }
+
+  task->block_on_io();
+  assert(overlapped.Internal != STATUS_PENDING);
+  if (overlapped.Internal != 0 && overlapped.Internal != STATUS_BUFFER_OVERFLOW_) {
+    // FIXME: this is probably not a valid way to pass an error
+    return socket_error(static_cast<DWORD>(overlapped.Internal));
+  }
+
+  msg.size = std::size_t{overlapped.InternalHigh};
+  msg.truncated = overlapped.Internal == STATUS_BUFFER_OVERFLOW_;
+  detail::from_sockaddr(from, msg.ip, msg.port);
+  received = 1;
+
+  // pick up everything that arrived while the task was parked
+  s->m_recv_error = recv_queued(s->m_socket, msgs, n, received);
+  return received;
+}
+
+Result<std::size_t> IoEngine::send_batch(Task* task, Socket* s,
+                                         const Datagram* msgs,
+                                         std::size_t n) noexcept {
+  if (s->m_send_error) {
+    return std::exchange(s->m_send_error, {});
+  }
+
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  std::size_t sent = 0;
+  while (sent < n) {
+    const auto& msg = msgs[sent];
+    const auto to = detail::to_sockaddr(msg.ip, msg.port);
+    const int len = ::sendto(s->m_socket, msg.data, static_cast<int>(msg.size), 0,
+                             reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    if (len != SOCKET_ERROR) {
+      ++sent;
+      continue;
+    }
+
+    const auto err = ::WSAGetLastError();
+    if (err != WSAEWOULDBLOCK) {
+      if (sent != 0) {
+        // reported by the next call
+        s->m_send_error = socket_error(err);
+        break;
+      }
+
+      return socket_error(err);
+    }
+
+    // send buffer is full, park until this datagram is handed to the stack
+    WSABUF buffer;
+    buffer.buf = msg.data;
+    buffer.len = static_cast<ULONG>(msg.size);
+    IoOp overlapped{task};
+
+    if (::WSASendTo(s->m_socket, &buffer, 1, nullptr, 0,
+                    reinterpret_cast<const sockaddr*>(&to), sizeof(to),
+                    &overlapped, nullptr) != 0) {
+      auto e = last_socket_error();
+      if (e.value() != ERROR_IO_PENDING) {
+        if (sent != 0) {
+          s->m_send_error = e;
+          break;
+        }
+
+        return e;
+      }
+    }
+
+    task->block_on_io();
+    assert(overlapped.Internal != STATUS_PENDING);
+    if (overlapped.Internal != 0) {
+      // FIXME: this is probably not a valid way to pass an error
+      auto e = socket_error(static_cast<DWORD>(overlapped.Internal));
+      if (sent != 0) {
+        s->m_send_error = e;
+        break;
+      }
+
+      return e;
+    }
+
+    ++sent;
+  }
+
+  task->consume_budget();
+  return sent;
+}
+
+Result<std::size_t> IoEngine::sendfile(Task* task, Socket* s, File* f,
+                                       std::uint64_t offset,
+                                       std::size_t n) noexcept {
+  if (n == 0) {
+    // TransmitFile() treats 0 as "send the whole file"
+    return std::size_t{0};
+  }
+
+  if (auto e = lazy_register(s)) {
+    return e;
+  }
+
+  constexpr std::size_t max_transmit = 0x7ffffffe;
+  IoOp overlapped{task};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+  if (!::TransmitFile(s->m_socket, f->m_handle,
+                      static_cast<DWORD>((std::min)(n, max_transmit)), 0,
+                      &overlapped, nullptr, 0)) {
     auto err = last_socket_error();
     if (err.value() != ERROR_IO_PENDING) {
       return err;
     }
   }
 
-  TRACE_BLOCK;
   task->block_on_io();
   assert(overlapped.Internal != STATUS_PENDING);
   if (overlapped.Internal != 0) {
@@ -206,31 +576,33 @@ Result<std::size_t> IoEngine::send(Task* task, Socket* s, const char* data,
   return std::size_t{overlapped.InternalHigh};
 }
 
-Result<std::size_t> IoEngine::recv(Task* task, Socket* s, char* data,
-                                   std::size_t n) noexcept {
-  if (auto e = lazy_register(task, s)) {
+Result<std::size_t> IoEngine::read(Task* task, File* f, std::uint64_t offset,
+                                   char* data, std::size_t n) noexcept {
+  if (auto e = lazy_register(f)) {
     return e;
   }
 
-  WSABUF buffer;
-  buffer.buf = data;
-  buffer.len = static_cast<ULONG>(n);
+  IoOp overlapped{task};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
-  DWORD received{0};
-  DWORD flags{0};
-  WSAOVERLAPPED overlapped{};
+  if (!::ReadFile(f->m_handle, data, clamp_len(n), nullptr, &overlapped)) {
+    auto err = last_os_error();
+    if (err.value() == ERROR_HANDLE_EOF) {
+      return std::size_t{0};
+    }
 
-  if (::WSARecv(s->m_socket, &buffer, 1, &received, &flags, &overlapped,
-                nullptr) != 0) {
-    auto err = last_socket_error();
     if (err.value() != ERROR_IO_PENDING) {
       return err;
     }
   }
 
-  TRACE_BLOCK;
   task->block_on_io();
   assert(overlapped.Internal != STATUS_PENDING);
+  if (overlapped.Internal == STATUS_END_OF_FILE_) {
+    return std::size_t{0};
+  }
+
   if (overlapped.Internal != 0) {
     // FIXME: this is probably not a valid way to pass an error
     return socket_error(static_cast<DWORD>(overlapped.Internal));
@@ -239,44 +611,117 @@ Result<std::size_t> IoEngine::recv(Task* task, Socket* s, char* data,
   return std::size_t{overlapped.InternalHigh};
 }
 
-std::error_code IoEngine::shutdown(Task* task, Socket* s) noexcept {
-  if (auto e = lazy_register(task, s)) {
+Result<std::size_t> IoEngine::write(Task* task, File* f, std::uint64_t offset,
+                                    const char* data, std::size_t n) noexcept {
+  if (auto e = lazy_register(f)) {
     return e;
   }
 
-  OVERLAPPED overlapped{};
-  DWORD flags = 0;
-  DWORD reserved = 0;
+  IoOp overlapped{task};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
-  if (!DisconnectEx(s->m_socket, &overlapped, flags, reserved)) {
-    auto err = last_socket_error();
+  if (!::WriteFile(f->m_handle, data, clamp_len(n), nullptr, &overlapped)) {
+    auto err = last_os_error();
     if (err.value() != ERROR_IO_PENDING) {
       return err;
     }
   }
 
-  TRACE_BLOCK;
   task->block_on_io();
   assert(overlapped.Internal != STATUS_PENDING);
   if (overlapped.Internal != 0) {
     // FIXME: this is probably not a valid way to pass an error
     return socket_error(static_cast<DWORD>(overlapped.Internal));
   }
-  return {};
+
+  return std::size_t{overlapped.InternalHigh};
+}
+
+void IoEngine::notify(IoOp* op) noexcept {
+  {
+    std::lock_guard lock(m_local->mutex);
+    m_local->ops.push_back(op);
+    m_local->pending.store(true, std::memory_order_relaxed);
+  }
+
+  // NOTE: pairs with the fence in wait(), either the owner sees pending or
+  //       we see it sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_local->sleeping.load(std::memory_order_relaxed)) {
+    wake();
+  }
+}
+
+void IoEngine::wake() noexcept {
+  // NOTE: packets without OVERLAPPED are skipped by wait()
+  const auto status = ::PostQueuedCompletionStatus(m_iocp.get(), 0, 0, nullptr);
+  assert(status);
+  (void)status;
+}
+
+void IoEngine::interrupt() noexcept {
+  m_local->interrupted.store(true, std::memory_order_relaxed);
+  // NOTE: pairs with the fence in wait(), like notify()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_local->sleeping.load(std::memory_order_relaxed)) {
+    wake();
+  }
+}
+
+std::size_t IoEngine::take_local(CompletionEvent* events,
+                                 std::size_t n) noexcept {
+  if (!m_local->pending.load(std::memory_order_acquire)) {
+    return 0;
+  }
+
+  std::lock_guard lock(m_local->mutex);
+  auto& ops = m_local->ops;
+  const auto n_events = (std::min)(n, ops.size());
+  for (std::size_t i = 0; i < n_events; ++i) {
+    events[i].context = ops[i]->task;
+    events[i].result = static_cast<std::int64_t>(ops[i]->InternalHigh);
+  }
+  ops.erase(ops.begin(), ops.begin() + static_cast<std::ptrdiff_t>(n_events));
+  m_local->pending.store(!ops.empty(), std::memory_order_relaxed);
+  return n_events;
 }
 
 std::size_t IoEngine::wait(CompletionEvent* events, std::size_t n,
                            std::size_t timeout_ms) noexcept {
+  // local completions are served without a system call, but the IOCP is
+  // still polled every few waits so that sockets aren't starved
+  constexpr std::uint32_t max_local_streak = 16;
+  std::size_t n_events = take_local(events, n);
+  if (n_events != 0) {
+    if (++m_local_streak < max_local_streak || n_events == n) {
+      return n_events;
+    }
+    timeout_ms = 0;
+  }
+  m_local_streak = 0;
+
+  if (timeout_ms != 0) {
+    m_local->sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_local->pending.load(std::memory_order_relaxed) ||
+        m_local->interrupted.exchange(false, std::memory_order_relaxed)) {
+      timeout_ms = 0;
+    }
+  }
+
   constexpr std::size_t max_entries = 64;
   OVERLAPPED_ENTRY entries[max_entries];
   ULONG got_entries{0};
   const bool status =
       ::GetQueuedCompletionStatusEx(
-          m_iocp.get(), entries, static_cast<ULONG>((std::min)(max_entries, n)),
+          m_iocp.get(), entries,
+          static_cast<ULONG>((std::min)(max_entries, n - n_events)),
           &got_entries, static_cast<DWORD>(timeout_ms), FALSE) != 0;
+  m_local->sleeping.store(false, std::memory_order_relaxed);
   if (!status) {
     // timed out
-    return 0;
+    got_entries = 0;
   }
 
   // std::cout << got_entries << " ops completed: " << std::endl;
@@ -284,10 +729,25 @@ std::size_t IoEngine::wait(CompletionEvent* events, std::size_t n,
     // std::cout << "task: " << (void*)entries[i].lpCompletionKey
     //          << " waking up for " << (void*)entries[i].lpOverlapped
     //          << std::endl;
-    events[i].context = reinterpret_cast<void*>(entries[i].lpCompletionKey);
-    events[i].result = entries[i].dwNumberOfBytesTransferred;
+    auto* op = static_cast<IoOp*>(entries[i].lpOverlapped);
+    if (!op) {
+      // posted by wake()
+      continue;
+    }
+
+    if (op->select) {
+      // the task is woken by the select if it waits for this op
+      op->select->complete(op);
+      continue;
+    }
+
+    events[n_events].context = op->task;
+    events[n_events].result = entries[i].dwNumberOfBytesTransferred;
+    ++n_events;
   }
-  return got_entries;
+
+  // local completions which woke us up or raced with the wait
+  return n_events + take_local(events + n_events, n - n_events);
 }
 
 }  // namespace rt
\ No newline at end of file
@@ -1,15 +1,61 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include "file.hpp"
 #include "handle.hpp"
 #include "result.hpp"
 #include "socket.hpp"
 
+#include <afunix.h>
+
 
 namespace rt {
 
+class IoSelect;
+
+// Every operation issued through IoEngine uses IoOp instead of a plain
+// OVERLAPPED, completions are routed to the task stored here, so handles
+// stay registered with an engine regardless of which task uses them
+struct IoOp : OVERLAPPED {
+  explicit IoOp(Task* t) noexcept : OVERLAPPED{}, task(t) {}
+
+  Task* task;
+  // completions of operations issued through IoSelect are handed to it
+  // instead of waking the task
+  IoSelect* select{nullptr};
+};
+
+// AcceptEx() writes addresses and needs the socket to be created upfront,
+// both have to live until the operation completes
+struct AcceptOp : IoOp {
+  explicit AcceptOp(Task* t) noexcept : IoOp(t) {}
+
+  Socket client;
+  // large enough for both AF_INET and AF_UNIX addresses
+  char addresses[2 * ((std::max)(sizeof(sockaddr_in), sizeof(SOCKADDR_UN)) + 16)];
+};
+
+namespace detail {
+
+// Completions posted by notify(), these never go through the kernel unless
+// the owning thread has to be woken up
+struct LocalCompletions {
+  std::mutex mutex;
+  std::vector<IoOp*> ops;
+  std::atomic<bool> pending{false};
+  std::atomic<bool> sleeping{false};  // owner is blocked in the IOCP wait
+  std::atomic<bool> interrupted{false};  // see IoEngine::interrupt()
+};
+
+}  // namespace detail
+
 struct CompletionEvent {
   std::int64_t result{-1};
   void* context{nullptr};
@@ -31,23 +77,75 @@ class IoEngine {
 
 
   Result<Socket> accept(Task* task, Socket* s) noexcept;
+  Result<Socket> connect(Task* task, IpAddr ip, Port port) noexcept;
   Result<std::size_t> send(Task* task, Socket* s, const char* data, std::size_t n) noexcept;
+  // gathers up to 16 slices into a single send
+  Result<std::size_t> send_vectored(Task* task, Socket* s, const IoSlice* slices,
+                                    std::size_t n) noexcept;
   Result<std::size_t> recv(Task* task, Socket* s, char* data, std::size_t n) noexcept;
+  // scatters into up to 16 slices
+  Result<std::size_t> recv_vectored(Task* task, Socket* s, const IoSliceMut* slices,
+                                    std::size_t n) noexcept;
   std::error_code shutdown(Task* task, Socket* s) noexcept;
-
-  // send()
-  // recv()
+  Result<std::size_t> recv_batch(Task* task, Socket* s, Datagram* msgs,
+                                 std::size_t n) noexcept;
+  Result<std::size_t> send_batch(Task* task, Socket* s, const Datagram* msgs,
+                                 std::size_t n) noexcept;
+  // transmits file content directly from the file system cache, n should be
+  // less than 2GiB
+  Result<std::size_t> sendfile(Task* task, Socket* s, File* f,
+                               std::uint64_t offset, std::size_t n) noexcept;
+
+  Result<std::size_t> read(Task* task, File* f, std::uint64_t offset, char* data,
+                           std::size_t n) noexcept;
+  Result<std::size_t> write(Task* task, File* f, std::uint64_t offset,
+                            const char* data, std::size_t n) noexcept;
+
+  // Asynchronous halves of socket operations, used by coroutine awaiters.
+  // start_*() issues the operation, if it returns an error no completion
+  // will be posted. Once the completion of op is dequeued, the result is
+  // taken with finish_*() or transferred().
+  std::error_code start_accept(AcceptOp* op, Socket* s) noexcept;
+  Result<Socket> finish_accept(AcceptOp* op, Socket* s) noexcept;
+  // s receives the newly created socket
+  std::error_code start_connect(IoOp* op, Socket* s, IpAddr ip, Port port) noexcept;
+  Result<Socket> finish_connect(IoOp* op, Socket* s) noexcept;
+  std::error_code start_send(IoOp* op, Socket* s, const IoSlice* slices,
+                             std::size_t n) noexcept;
+  std::error_code start_recv(IoOp* op, Socket* s, const IoSliceMut* slices,
+                             std::size_t n) noexcept;
+  std::error_code start_shutdown(IoOp* op, Socket* s) noexcept;
+  // number of bytes transferred by a completed op or its error
+  static Result<std::size_t> transferred(const IoOp& op) noexcept;
+
+  // posts completion of op, the task waiting for it is woken up as if it was
+  // a regular IO operation. Can be called from any thread. The result is
+  // taken from op->Internal (error) and op->InternalHigh (bytes).
+  void notify(IoOp* op) noexcept;
+  // wakes up a thread blocked in wait() without completing anything, can be
+  // called from any thread
+  void wake() noexcept;
+  // makes wait() return early if it's blocked or about to block, used when
+  // the owner has other work to pick up (e.g. injected tasks). Posts to the
+  // IOCP only if the owner is actually asleep. Can be called from any thread.
+  void interrupt() noexcept;
 
   // returns 0 on timeout
   std::size_t wait(CompletionEvent* events, std::size_t n, std::size_t timeout_ms) noexcept;
 private:
   IoEngine(Handle h) noexcept;
 
-  std::error_code lazy_register(Task* task, Socket* s) noexcept;
-  std::error_code add(Handle h, void* context) noexcept;
+  friend class Socket;
+
+  template <typename T>
+  std::error_code lazy_register(T* s) noexcept;
+  std::error_code add(Handle h) noexcept;
   std::error_code remove(Handle h) noexcept;
+  std::size_t take_local(CompletionEvent* events, std::size_t n) noexcept;
 
   HandleOwner m_iocp;
+  std::unique_ptr<detail::LocalCompletions> m_local;
+  std::uint32_t m_local_streak{0};  // waits served only by local completions
 };
 
 
@@ -0,0 +1,446 @@
+#include "loopback.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "io_engine.hpp"
+#include "task.hpp"
+#include "worker.hpp"
+
+
+namespace rt {
+
+static std::error_code socket_error(DWORD value) {
+  return {static_cast<int>(value), std::system_category()};
+}
+
+// completes an operation parked on one of the pipes, the lock of the pipe
+// should be held
+static void complete(IoOp* op, IoEngine* engine, std::size_t n,
+                     DWORD error) noexcept {
+  op->Internal = error;
+  op->InternalHigh = n;
+  engine->notify(op);
+}
+
+namespace detail {
+
+// One direction of a connection, a ring buffer with at most one parked
+// reader and one parked writer. The reader parks only when the buffer is
+// empty and the writer only when it is full.
+struct LoopbackPipe {
+  std::mutex mutex;
+  std::unique_ptr<char[]> buffer;
+  std::size_t capacity{0};
+  std::size_t head{0};
+  std::size_t size{0};
+  bool shut{false};           // writer won't send anymore
+  bool reader_closed{false};  // nobody will receive, sends fail
+
+  IoOp* reader{nullptr};
+  IoEngine* reader_engine{nullptr};
+  const IoSliceMut* read_slices{nullptr};
+  std::size_t n_read_slices{0};
+
+  IoOp* writer{nullptr};
+  IoEngine* writer_engine{nullptr};
+  const IoSlice* write_slices{nullptr};
+  std::size_t n_write_slices{0};
+
+  // copies as much as fits, returns number of bytes copied
+  std::size_t push(const IoSlice* slices, std::size_t n) {
+    if (!buffer) {
+      buffer = std::make_unique_for_overwrite<char[]>(capacity);
+    }
+
+    std::size_t pushed = 0;
+    for (std::size_t i = 0; i < n && size < capacity; ++i) {
+      const char* data = slices[i].data;
+      std::size_t left = slices[i].size;
+      while (left != 0 && size < capacity) {
+        const auto tail = (head + size) % capacity;
+        const auto chunk = (std::min)({left, capacity - size, capacity - tail});
+        std::memcpy(buffer.get() + tail, data, chunk);
+        data += chunk;
+        left -= chunk;
+        size += chunk;
+        pushed += chunk;
+      }
+    }
+    return pushed;
+  }
+
+  std::size_t pop(const IoSliceMut* slices, std::size_t n) {
+    std::size_t popped = 0;
+    for (std::size_t i = 0; i < n && size != 0; ++i) {
+      char* data = slices[i].data;
+      std::size_t left = slices[i].size;
+      while (left != 0 && size != 0) {
+        const auto chunk = (std::min)({left, size, capacity - head});
+        std::memcpy(data, buffer.get() + head, chunk);
+        data += chunk;
+        left -= chunk;
+        size -= chunk;
+        head = (head + chunk) % capacity;
+        popped += chunk;
+      }
+    }
+
+    if (size == 0) {
+      head = 0;
+    }
+    return popped;
+  }
+
+  void wake_reader() noexcept {
+    if (!reader) {
+      return;
+    }
+
+    if (size != 0) {
+      complete(reader, reader_engine, pop(read_slices, n_read_slices), 0);
+    } else if (shut) {
+      complete(reader, reader_engine, 0, 0);
+    } else {
+      return;
+    }
+    reader = nullptr;
+  }
+
+  void wake_writer() noexcept {
+    if (!writer) {
+      return;
+    }
+
+    if (reader_closed) {
+      complete(writer, writer_engine, 0, WSAECONNRESET);
+    } else if (size < capacity) {
+      complete(writer, writer_engine, push(write_slices, n_write_slices), 0);
+    } else {
+      return;
+    }
+    writer = nullptr;
+  }
+};
+
+struct LoopbackConnection {
+  explicit LoopbackConnection(std::size_t capacity) noexcept {
+    for (auto& pipe : pipes) {
+      pipe.capacity = capacity;
+    }
+  }
+
+  LoopbackPipe pipes[2];
+};
+
+struct LoopbackBacklog {
+  std::mutex mutex;
+  Port port{0};
+  std::size_t limit{0};
+  std::deque<LoopbackStream> pending;
+  bool closed{false};
+
+  IoOp* acceptor{nullptr};
+  IoEngine* acceptor_engine{nullptr};
+  LoopbackStream* accepted{nullptr};
+};
+
+}  // namespace detail
+
+struct LoopbackRegistry {
+  std::mutex mutex;
+  std::unordered_map<Port, std::shared_ptr<detail::LoopbackBacklog>> ports;
+};
+
+static LoopbackRegistry& registry() {
+  static LoopbackRegistry r;
+  return r;
+}
+
+static std::size_t total_size(const IoSlice* slices, std::size_t n) noexcept {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    total += slices[i].size;
+  }
+  return total;
+}
+
+static std::size_t total_size(const IoSliceMut* slices, std::size_t n) noexcept {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    total += slices[i].size;
+  }
+  return total;
+}
+
+std::pair<LoopbackStream, LoopbackStream> LoopbackStream::pair(std::size_t capacity) {
+  assert(capacity != 0);
+  auto conn = std::make_shared<detail::LoopbackConnection>(capacity);
+  return {LoopbackStream{conn, 0}, LoopbackStream{conn, 1}};
+}
+
+Result<LoopbackStream> LoopbackStream::connect(Port port) noexcept {
+  std::shared_ptr<detail::LoopbackBacklog> backlog;
+  {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    auto it = r.ports.find(port);
+    if (it == r.ports.end()) {
+      return socket_error(WSAECONNREFUSED);
+    }
+    backlog = it->second;
+  }
+
+  auto [client, server] = pair();
+  {
+    std::lock_guard lock(backlog->mutex);
+    if (backlog->closed) {
+      return socket_error(WSAECONNREFUSED);
+    }
+
+    if (backlog->acceptor) {
+      *backlog->accepted = std::move(server);
+      complete(backlog->acceptor, backlog->acceptor_engine, 0, 0);
+      backlog->acceptor = nullptr;
+    } else if (backlog->pending.size() < backlog->limit) {
+      backlog->pending.push_back(std::move(server));
+    } else {
+      return socket_error(WSAECONNREFUSED);
+    }
+  }
+
+  consume_budget();
+  return std::move(client);
+}
+
+void LoopbackStream::close() noexcept {
+  if (!m_conn) {
+    return;
+  }
+
+  shutdown();
+
+  auto& pipe = m_conn->pipes[1 - m_side];
+  {
+    std::lock_guard lock(pipe.mutex);
+    pipe.reader_closed = true;
+    pipe.buffer.reset();
+    pipe.head = 0;
+    pipe.size = 0;
+    pipe.wake_writer();
+  }
+  m_conn.reset();
+}
+
+Result<std::size_t> LoopbackStream::send(const char* data, std::size_t n) noexcept {
+  const IoSlice slice{data, n};
+  return send_vectored(&slice, 1);
+}
+
+std::error_code LoopbackStream::send_all(const char* data, std::size_t n) noexcept {
+  std::size_t sent = 0;
+  while (sent < n) {
+    const auto s = send(data + sent, n - sent);
+    if (auto e = s.err()) {
+      return e;
+    }
+
+    sent += *s;
+  }
+
+  return {};
+}
+
+Result<std::size_t> LoopbackStream::send_vectored(const IoSlice* slices,
+                                                  std::size_t n) noexcept {
+  assert(m_conn);
+  auto* task = current_task();
+  auto& pipe = m_conn->pipes[m_side];
+  IoOp op{task};
+  {
+    std::unique_lock lock(pipe.mutex);
+    if (pipe.shut) {
+      return socket_error(WSAESHUTDOWN);
+    }
+
+    if (pipe.reader_closed) {
+      return socket_error(WSAECONNRESET);
+    }
+
+    if (total_size(slices, n) == 0) {
+      return std::size_t{0};
+    }
+
+    if (const auto pushed = pipe.push(slices, n); pushed != 0) {
+      pipe.wake_reader();
+      lock.unlock();
+      consume_budget();
+      return pushed;
+    }
+
+    assert(!pipe.writer);
+    pipe.writer = &op;
+    pipe.writer_engine = task->owner->io();
+    pipe.write_slices = slices;
+    pipe.n_write_slices = n;
+  }
+
+  task->block_on_io();
+  return IoEngine::transferred(op);
+}
+
+std::error_code LoopbackStream::send_all_vectored(IoSlice* slices,
+                                                  std::size_t n) noexcept {
+  while (n != 0) {
+    if (slices->size == 0) {
+      ++slices;
+      --n;
+      continue;
+    }
+
+    const auto s = send_vectored(slices, n);
+    if (auto e = s.err()) {
+      return e;
+    }
+
+    auto sent = *s;
+    while (sent != 0) {
+      const auto k = (std::min)(sent, slices->size);
+      slices->data += k;
+      slices->size -= k;
+      sent -= k;
+      if (slices->size == 0) {
+        ++slices;
+        --n;
+      }
+    }
+  }
+
+  return {};
+}
+
+Result<std::size_t> LoopbackStream::recv(char* data, std::size_t n) noexcept {
+  const IoSliceMut slice{data, n};
+  return recv_vectored(&slice, 1);
+}
+
+Result<std::size_t> LoopbackStream::recv_vectored(const IoSliceMut* slices,
+                                                  std::size_t n) noexcept {
+  assert(m_conn);
+  auto* task = current_task();
+  auto& pipe = m_conn->pipes[1 - m_side];
+  IoOp op{task};
+  {
+    std::unique_lock lock(pipe.mutex);
+    if (total_size(slices, n) == 0) {
+      return std::size_t{0};
+    }
+
+    if (const auto popped = pipe.pop(slices, n); popped != 0) {
+      pipe.wake_writer();
+      lock.unlock();
+      consume_budget();
+      return popped;
+    }
+
+    if (pipe.shut) {
+      return std::size_t{0};
+    }
+
+    assert(!pipe.reader);
+    pipe.reader = &op;
+    pipe.reader_engine = task->owner->io();
+    pipe.read_slices = slices;
+    pipe.n_read_slices = n;
+  }
+
+  task->block_on_io();
+  return IoEngine::transferred(op);
+}
+
+std::error_code LoopbackStream::shutdown() noexcept {
+  assert(m_conn);
+  auto& pipe = m_conn->pipes[m_side];
+  std::lock_guard lock(pipe.mutex);
+  pipe.shut = true;
+  pipe.wake_reader();
+  return {};
+}
+
+Result<LoopbackListener> LoopbackListener::bind(Port port,
+                                                std::size_t backlog) noexcept {
+  auto& r = registry();
+  std::lock_guard lock(r.mutex);
+  if (r.ports.contains(port)) {
+    return socket_error(WSAEADDRINUSE);
+  }
+
+  LoopbackListener listener;
+  listener.m_backlog = std::make_shared<detail::LoopbackBacklog>();
+  listener.m_backlog->port = port;
+  listener.m_backlog->limit = backlog;
+  r.ports.emplace(port, listener.m_backlog);
+  return listener;
+}
+
+void LoopbackListener::close() noexcept {
+  if (!m_backlog) {
+    return;
+  }
+
+  {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    auto it = r.ports.find(m_backlog->port);
+    if (it != r.ports.end() && it->second == m_backlog) {
+      r.ports.erase(it);
+    }
+  }
+
+  {
+    std::lock_guard lock(m_backlog->mutex);
+    m_backlog->closed = true;
+    m_backlog->pending.clear();
+    if (m_backlog->acceptor) {
+      complete(m_backlog->acceptor, m_backlog->acceptor_engine, 0,
+               WSA_OPERATION_ABORTED);
+      m_backlog->acceptor = nullptr;
+    }
+  }
+  m_backlog.reset();
+}
+
+Result<LoopbackStream> LoopbackListener::accept() noexcept {
+  assert(m_backlog);
+  auto* task = current_task();
+  LoopbackStream accepted;
+  IoOp op{task};
+  {
+    std::unique_lock lock(m_backlog->mutex);
+    if (!m_backlog->pending.empty()) {
+      accepted = std::move(m_backlog->pending.front());
+      m_backlog->pending.pop_front();
+      lock.unlock();
+      consume_budget();
+      return std::move(accepted);
+    }
+
+    assert(!m_backlog->acceptor);
+    m_backlog->acceptor = &op;
+    m_backlog->acceptor_engine = task->owner->io();
+    m_backlog->accepted = &accepted;
+  }
+
+  task->block_on_io();
+  if (auto e = IoEngine::transferred(op).err()) {
+    return e;
+  }
+
+  return std::move(accepted);
+}
+
+}  // namespace rt
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#include "result.hpp"
+#include "socket.hpp"
+
+namespace rt {
+
+namespace detail {
+
+struct LoopbackConnection;
+struct LoopbackBacklog;
+
+}  // namespace detail
+
+// In-process stream connected to another LoopbackStream, data never leaves
+// user space. Parked operations are completed with IoEngine::notify(), so
+// tasks using it are scheduled exactly like those using sockets, but without
+// any kernel cost. Both ends can be used from different workers.
+// NOTE: only for stackful tasks, like the blocking Socket API
+class LoopbackStream {
+ public:
+  // bytes buffered in each direction, memory is allocated on first send
+  static constexpr std::size_t DEFAULT_CAPACITY = 16 * 1024;
+
+  LoopbackStream() noexcept = default;
+  LoopbackStream(const LoopbackStream&) = delete;
+  LoopbackStream(LoopbackStream&& other) noexcept
+      : m_conn(std::move(other.m_conn)), m_side(other.m_side) {}
+  LoopbackStream& operator=(const LoopbackStream&) = delete;
+  LoopbackStream& operator=(LoopbackStream&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+
+    close();
+    m_conn = std::move(other.m_conn);
+    m_side = other.m_side;
+    return *this;
+  }
+  ~LoopbackStream() noexcept { close(); }
+
+  // two connected ends
+  static std::pair<LoopbackStream, LoopbackStream> pair(
+      std::size_t capacity = DEFAULT_CAPACITY);
+  // fails with WSAECONNREFUSED if nothing listens on port or its backlog is
+  // full, never parks
+  static Result<LoopbackStream> connect(Port port) noexcept;
+
+  bool valid() const noexcept { return m_conn != nullptr; }
+  // pending and future sends of the peer fail with WSAECONNRESET
+  void close() noexcept;
+
+  // parks only when the peer's buffer is full, returns number of bytes sent
+  Result<std::size_t> send(const char* data, std::size_t n) noexcept;
+  std::error_code send_all(const char* data, std::size_t n) noexcept;
+  Result<std::size_t> send_vectored(const IoSlice* slices, std::size_t n) noexcept;
+  // NOTE: slices are modified to track progress
+  std::error_code send_all_vectored(IoSlice* slices, std::size_t n) noexcept;
+  // parks only when there is nothing buffered, returns 0 once the peer has
+  // shut down and everything was read
+  Result<std::size_t> recv(char* data, std::size_t n) noexcept;
+  Result<std::size_t> recv_vectored(const IoSliceMut* slices, std::size_t n) noexcept;
+  // shuts down sending
+  std::error_code shutdown() noexcept;
+
+ private:
+  LoopbackStream(std::shared_ptr<detail::LoopbackConnection> conn,
+                 std::size_t side) noexcept
+      : m_conn(std::move(conn)), m_side(side) {}
+
+  std::shared_ptr<detail::LoopbackConnection> m_conn;
+  std::size_t m_side{0};  // sends to pipes[m_side], receives from the other
+};
+
+// Accepts LoopbackStream::connect() to a port, ports are process wide and
+// separate from those of real sockets
+class LoopbackListener {
+ public:
+  LoopbackListener() noexcept = default;
+  LoopbackListener(const LoopbackListener&) = delete;
+  LoopbackListener(LoopbackListener&&) noexcept = default;
+  LoopbackListener& operator=(const LoopbackListener&) = delete;
+  LoopbackListener& operator=(LoopbackListener&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+
+    close();
+    m_backlog = std::move(other.m_backlog);
+    return *this;
+  }
+  ~LoopbackListener() noexcept { close(); }
+
+  // fails with WSAEADDRINUSE if port is taken, connections beyond backlog
+  // are refused
+  static Result<LoopbackListener> bind(Port port, std::size_t backlog = 1024) noexcept;
+
+  bool valid() const noexcept { return m_backlog != nullptr; }
+  // releases the port and drops pending connections
+  void close() noexcept;
+
+  Result<LoopbackStream> accept() noexcept;
+
+ private:
+  std::shared_ptr<detail::LoopbackBacklog> m_backlog;
+};
+
+}  // namespace rt
@@ -0,0 +1,82 @@
+#include "metrics.hpp"
+
+
+namespace rt {
+
+std::uint64_t HistogramSnapshot::count() const noexcept {
+  std::uint64_t n = 0;
+  for (auto b : buckets) {
+    n += b;
+  }
+  return n;
+}
+
+std::uint64_t HistogramSnapshot::percentile(double p) const noexcept {
+  const auto total = count();
+  if (total == 0) {
+    return 0;
+  }
+
+  const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(total - 1)) + 1;
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return i == 0 ? 0 : (std::uint64_t{1} << i) - 1;
+    }
+  }
+
+  return ~std::uint64_t{0};
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) noexcept {
+  for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+}
+
+HistogramSnapshot Histogram::snapshot() const noexcept {
+  HistogramSnapshot s;
+  for (std::size_t i = 0; i < HistogramSnapshot::N_BUCKETS; ++i) {
+    s.buckets[i] = m_buckets[i].get();
+  }
+  return s;
+}
+
+void WorkerMetricsSnapshot::merge(const WorkerMetricsSnapshot& other) noexcept {
+  spawns += other.spawns;
+  polls += other.polls;
+  forced_yields += other.forced_yields;
+  steal_attempts += other.steal_attempts;
+  steals += other.steals;
+  migrations += other.migrations;
+  io_waits += other.io_waits;
+  io_completions += other.io_completions;
+  idle_ns += other.idle_ns;
+  tasks_created += other.tasks_created;
+  tasks_free += other.tasks_free;
+  queue_depth += other.queue_depth;
+  queue_grows += other.queue_grows;
+  io_batch.merge(other.io_batch);
+  schedule_delay_ns.merge(other.schedule_delay_ns);
+}
+
+WorkerMetricsSnapshot WorkerMetrics::snapshot() const noexcept {
+  WorkerMetricsSnapshot s;
+  s.spawns = spawns.get();
+  s.polls = polls.get();
+  s.forced_yields = forced_yields.get();
+  s.steal_attempts = steal_attempts.get();
+  s.steals = steals.get();
+  s.migrations = migrations.get();
+  s.io_waits = io_waits.get();
+  s.io_completions = io_completions.get();
+  s.idle_ns = idle_ns.get();
+  s.tasks_created = tasks_created.get();
+  s.tasks_free = tasks_free.get();
+  s.io_batch = io_batch.snapshot();
+  s.schedule_delay_ns = schedule_delay_ns.snapshot();
+  return s;
+}
+
+} // namespace rt
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace rt {
+
+inline std::uint64_t monotonic_ns() noexcept {
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+// Value written only by the owning worker and read by anyone.
+// NOTE: there is a single writer, so plain load + store is enough,
+//       no locked instructions on the hot path
+class Counter {
+ public:
+  Counter() noexcept = default;
+  Counter(const Counter& other) noexcept : m_value(other.get()) {}
+  Counter& operator=(const Counter& other) noexcept {
+    set(other.get());
+    return *this;
+  }
+
+  void add(std::uint64_t n = 1) noexcept {
+    m_value.store(m_value.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  void set(std::uint64_t value) noexcept {
+    m_value.store(value, std::memory_order_relaxed);
+  }
+
+  std::uint64_t get() const noexcept {
+    return m_value.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<std::uint64_t> m_value{0};
+};
+
+struct HistogramSnapshot {
+  static constexpr std::size_t N_BUCKETS = 48;
+
+  // bucket i holds values in [2^(i-1), 2^i), bucket 0 holds zeros
+  std::array<std::uint64_t, N_BUCKETS> buckets{};
+
+  std::uint64_t count() const noexcept;
+  // returns upper bound of the bucket where p-th percentile is, p is in [0, 1]
+  std::uint64_t percentile(double p) const noexcept;
+  void merge(const HistogramSnapshot& other) noexcept;
+};
+
+// Log2 histogram, same single writer rules as for Counter
+class Histogram {
+ public:
+  void record(std::uint64_t value) noexcept {
+    const auto bucket = (std::min)(static_cast<std::size_t>(std::bit_width(value)),
+                                   HistogramSnapshot::N_BUCKETS - 1);
+    m_buckets[bucket].add();
+  }
+
+  HistogramSnapshot snapshot() const noexcept;
+
+ private:
+  std::array<Counter, HistogramSnapshot::N_BUCKETS> m_buckets{};
+};
+
+struct WorkerMetricsSnapshot {
+  std::uint64_t spawns{0};
+  std::uint64_t polls{0};
+  std::uint64_t forced_yields{0};
+  std::uint64_t steal_attempts{0};
+  std::uint64_t steals{0};
+  std::uint64_t migrations{0};
+  std::uint64_t io_waits{0};
+  std::uint64_t io_completions{0};
+  std::uint64_t idle_ns{0};
+  std::uint64_t tasks_created{0};
+  std::uint64_t tasks_free{0};
+  std::uint64_t queue_depth{0};
+  std::uint64_t queue_grows{0};
+  HistogramSnapshot io_batch{};
+  HistogramSnapshot schedule_delay_ns{};
+
+  void merge(const WorkerMetricsSnapshot& other) noexcept;
+};
+
+// Per worker metrics, padded to not share cache lines with anything else
+struct alignas(128) WorkerMetrics {
+  Counter spawns;          // tasks spawned on this worker
+  Counter polls;           // tasks switched in
+  Counter forced_yields;   // yields caused by exhausted budget
+  Counter steal_attempts;  // calls to try_steal()
+  Counter steals;          // successful try_steal() calls
+  Counter migrations;      // tasks resumed on a different worker than before
+  Counter io_waits;        // calls to IoEngine::wait()
+  Counter io_completions;  // completions returned by IoEngine::wait()
+  Counter idle_ns;         // time spent inside of IoEngine::wait()
+  Counter tasks_created;   // tasks allocated from the heap
+  Counter tasks_free;      // tasks cached in freelist
+  Histogram io_batch;            // completions per IoEngine::wait() call
+  Histogram schedule_delay_ns;   // time from becoming ready to running
+
+  WorkerMetricsSnapshot snapshot() const noexcept;
+};
+
+struct RuntimeMetrics {
+  std::vector<WorkerMetricsSnapshot> workers;
+  WorkerMetricsSnapshot total;
+
+  // NOTE: tasks can finish on a different worker than the one that
+  //       allocated them, so only total is meaningful here
+  std::uint64_t live_tasks() const noexcept {
+    return total.tasks_created - total.tasks_free;
+  }
+};
+
+} // namespace rt
@@ -0,0 +1,23 @@
+#include "parallel.hpp"
+
+namespace rt::detail {
+
+void ForkJoinLatch::done() noexcept {
+  if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    // NOTE: the caller dropped its count, so m_engine is set and it's
+    //       either parked or about to park
+    m_engine->notify(&m_op);
+  }
+}
+
+void ForkJoinLatch::wait() noexcept {
+  auto* task = current_task();
+  m_engine = task->owner->io();
+  if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    return;
+  }
+
+  task->block_on_io();
+}
+
+}  // namespace rt::detail
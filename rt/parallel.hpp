@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <source_location>
+#include <type_traits>
+#include <utility>
+
+#include "io_engine.hpp"
+#include "task.hpp"
+#include "worker.hpp"
+
+namespace rt {
+
+namespace detail {
+
+// Counts tasks spawned by a fork-join call, the caller parks until all of
+// them finish. Lives on the caller's stack.
+class ForkJoinLatch {
+ public:
+  explicit ForkJoinLatch(Task* waiter) noexcept : m_op(waiter) {}
+
+  void add() noexcept { m_pending.fetch_add(1, std::memory_order_relaxed); }
+  // can be called from any worker
+  void done() noexcept;
+  // drops the count held by the caller and parks until the rest are done
+  void wait() noexcept;
+
+ private:
+  IoOp m_op;
+  IoEngine* m_engine{nullptr};  // of the worker the caller parks on
+  std::atomic<std::size_t> m_pending{1};
+};
+
+// Half of a range pushed to the local queue, it's executed either by its own
+// task (once stolen or scheduled) or by the task which split it off, when
+// it gets back to it first. Freed by whichever of them is the last one.
+struct ForkJoinNode {
+  ForkJoinNode(std::size_t b, std::size_t e) noexcept : begin(b), end(e) {}
+
+  bool claim() noexcept { return !claimed.exchange(true, std::memory_order_acq_rel); }
+  void release() noexcept {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  std::size_t begin;
+  std::size_t end;
+  Task* task{nullptr};      // executing the half, valid until it's claimed
+  Worker* worker{nullptr};  // which queued the task
+  std::atomic<bool> claimed{false};
+  std::atomic<std::uint8_t> refs{2};
+};
+
+struct NoResult {};
+
+template <typename T, typename Map, typename Reduce>
+class ForkJoin {
+ public:
+  ForkJoin(std::size_t grain, T identity, Map& map, Reduce& reduce) noexcept
+      : m_latch(current_task()),
+        m_grain(grain == 0 ? 1 : grain),
+        m_result(std::move(identity)),
+        m_map(map),
+        m_reduce(reduce) {}
+
+  T run(std::size_t begin, std::size_t end) {
+    auto* task = current_task();
+    merge(split(task->priority, begin, end));
+    m_latch.wait();
+    return std::move(m_result);
+  }
+
+ private:
+  // Pushes the upper half of the range to the local queue until it's no
+  // larger than the grain, so thieves take the largest pieces first. Then
+  // runs the leaf and goes back over the halves nobody has taken yet, newest
+  // (smallest) first, splitting them the same way. Tasks of halves taken
+  // back are dropped from the queue when they are still on its top.
+  T split(Priority priority, std::size_t begin, std::size_t end) {
+    // each pending half is at most half (rounded up) of the one below it,
+    // which bounds them by the number of bits in size_t
+    ForkJoinNode* pending[64];
+    std::size_t n_pending = 0;
+    std::optional<T> acc;
+    for (;;) {
+      while (end - begin > m_grain) {
+        const auto mid = begin + (end - begin) / 2;
+        auto* node = new ForkJoinNode{mid, end};
+        node->worker = current_task()->owner;
+        m_latch.add();
+        node->task = node->worker->create_task(
+            [this, node, priority] {
+              if (node->claim()) {
+                merge(split(priority, node->begin, node->end));
+              }
+              node->release();
+              m_latch.done();
+            },
+            priority, std::source_location::current());
+        node->worker->schedule(node->task, Placement::local());
+        assert(n_pending < 64);
+        pending[n_pending++] = node;
+        end = mid;
+      }
+
+      if (acc) {
+        acc = m_reduce(std::move(*acc), leaf(begin, end));
+      } else {
+        acc.emplace(leaf(begin, end));
+      }
+
+      ForkJoinNode* next = nullptr;
+      while (n_pending != 0 && !next) {
+        auto* node = pending[--n_pending];
+        if (node->claim()) {
+          next = node;
+        } else {
+          node->release();
+        }
+      }
+
+      if (!next) {
+        return std::move(*acc);
+      }
+
+      // NOTE: the claim was won, so the task hasn't got to its body yet and
+      //       only this thread pushes to the local queue, a matching top is
+      //       still the task queued above
+      if (next->worker == current_task()->owner && next->worker->take_back(next->task)) {
+        next->release();
+        m_latch.done();
+      }
+
+      begin = next->begin;
+      end = next->end;
+      next->release();
+    }
+  }
+
+  T leaf(std::size_t begin, std::size_t end) {
+    if constexpr (std::is_same_v<T, NoResult>) {
+      m_map(begin, end);
+      return {};
+    } else {
+      return m_map(begin, end);
+    }
+  }
+
+  void merge(T value) {
+    if constexpr (!std::is_same_v<T, NoResult>) {
+      std::lock_guard lock(m_mutex);
+      m_result = m_reduce(std::move(m_result), std::move(value));
+    }
+  }
+
+  ForkJoinLatch m_latch;
+  std::size_t m_grain;
+  std::mutex m_mutex;  // guards m_result
+  T m_result;
+  Map& m_map;
+  Reduce& m_reduce;
+};
+
+struct DiscardResults {
+  NoResult operator()(NoResult, NoResult) const noexcept { return {}; }
+};
+
+}  // namespace detail
+
+// Calls fn(first, last) for disjoint subranges covering [begin, end), each
+// at most grain long. Subranges are spread over workers by stealing, the
+// calling task runs those nobody took and parks only while the rest are
+// still running.
+// NOTE: stackful tasks only, fn should not throw. In shard mode everything
+//       runs on the calling shard.
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F&& fn) {
+  if (begin >= end) {
+    return;
+  }
+
+  detail::DiscardResults discard;
+  detail::ForkJoin<detail::NoResult, std::remove_reference_t<F>, detail::DiscardResults>
+      join{grain, {}, fn, discard};
+  join.run(begin, end);
+}
+
+// Like parallel_for(), but map(first, last) returns a partial result and
+// partial results are combined with reduce(a, b), starting with identity.
+// NOTE: reduce should be associative and commutative, the order in which
+//       partial results are combined depends on stealing
+template <typename T, typename Map, typename Reduce>
+T parallel_reduce(std::size_t begin, std::size_t end, std::size_t grain,
+                  T identity, Map&& map, Reduce&& reduce) {
+  if (begin >= end) {
+    return identity;
+  }
+
+  detail::ForkJoin<T, std::remove_reference_t<Map>, std::remove_reference_t<Reduce>>
+      join{grain, std::move(identity), map, reduce};
+  return join.run(begin, end);
+}
+
+}  // namespace rt
@@ -0,0 +1,45 @@
+#include "placement.hpp"
+#include "worker.hpp"
+
+
+namespace rt::detail {
+
+std::size_t pick_worker(Placement p, Worker* const* workers, std::size_t n,
+                        std::size_t local, XorShiftRng& rng,
+                        std::size_t& round_robin) noexcept {
+  assert(n != 0);
+  switch (p.kind) {
+    case Placement::Kind::Local:
+      if (local != NO_LOCAL_WORKER) {
+        return local;
+      }
+      // not on a worker, fall back to random
+      [[fallthrough]];
+    case Placement::Kind::Default:
+    case Placement::Kind::Random:
+      return rng.gen() % n;
+    case Placement::Kind::RoundRobin:
+      return round_robin++ % n;
+    case Placement::Kind::LeastLoaded: {
+      // power of two choices, avoids herding on a single least loaded
+      // worker without scanning all of them
+      const auto a = rng.gen() % n;
+      if (n == 1) {
+        return a;
+      }
+
+      auto b = rng.gen() % (n - 1);
+      if (b >= a) {
+        ++b;
+      }
+
+      return workers[b]->load() < workers[a]->load() ? b : a;
+    }
+    case Placement::Kind::Worker:
+      return p.worker % n;
+  }
+
+  return 0;
+}
+
+}  // namespace rt::detail
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "random.hpp"
+
+
+namespace rt {
+
+class Worker;
+
+// Chooses the worker a spawned task is queued on
+struct Placement {
+  enum class Kind : std::uint8_t {
+    Default,      // policy configured for the runtime
+    Random,
+    RoundRobin,   // rotates over all workers, separately for each spawner
+    LeastLoaded,  // shorter queue of two randomly chosen workers
+    Local,        // worker of the spawning task
+    Worker,       // explicit worker index
+  };
+
+  Kind kind{Kind::Default};
+  std::size_t worker{0};
+
+  static constexpr Placement runtime_default() noexcept { return {}; }
+  static constexpr Placement random() noexcept { return {Kind::Random}; }
+  static constexpr Placement round_robin() noexcept { return {Kind::RoundRobin}; }
+  static constexpr Placement least_loaded() noexcept { return {Kind::LeastLoaded}; }
+  static constexpr Placement local() noexcept { return {Kind::Local}; }
+  static constexpr Placement on(std::size_t index) noexcept {
+    return {Kind::Worker, index};
+  }
+};
+
+namespace detail {
+
+constexpr std::size_t NO_LOCAL_WORKER = static_cast<std::size_t>(-1);
+
+// returns index into workers, local is the index of the spawning worker or
+// NO_LOCAL_WORKER. p should not be Default.
+std::size_t pick_worker(Placement p, Worker* const* workers, std::size_t n,
+                        std::size_t local, XorShiftRng& rng,
+                        std::size_t& round_robin) noexcept;
+
+}  // namespace detail
+
+} // namespace rt
@@ -3,6 +3,13 @@
 namespace rt {
 
 Result<Runtime> Runtime::create(std::size_t n_threads) {
+  RuntimeConfig config{};
+  config.n_threads = n_threads;
+  return create(config);
+}
+
+Result<Runtime> Runtime::create(const RuntimeConfig& config) {
+  auto n_threads = config.n_threads;
   if (n_threads == 0) {
     n_threads = std::thread::hardware_concurrency();
   }
@@ -13,20 +20,61 @@ Result<Runtime> Runtime::create(std::size_t n_threads) {
   }
 
   Runtime runtime;
+  runtime.m_watchdog_config = config.watchdog;
+  runtime.m_placement = config.placement;
+  runtime.m_blocking = std::make_unique<BlockingPool>(config.blocking);
   runtime.m_workers.reserve(n_threads);
-  runtime.m_workers.emplace_back(std::move(*io));
+  runtime.m_workers.emplace_back(std::move(*io), runtime.m_blocking.get());
 
   for (std::size_t i = 1; i < n_threads; ++i) {
     auto io = runtime.m_workers.front().worker.io()->share();
     if (auto e = io.err()) {
       return e;
     }
-    runtime.m_workers.emplace_back(std::move(*io));
+    runtime.m_workers.emplace_back(std::move(*io), runtime.m_blocking.get());
+  }
+
+  for (auto& state : runtime.m_workers) {
+    runtime.m_all.emplace_back(&state.worker);
+  }
+
+  if (config.sharded) {
+    runtime.init_shards();
   }
 
   return runtime;
 }
 
+std::size_t Runtime::pick(Placement placement) noexcept {
+  if (placement.kind == Placement::Kind::Default) {
+    placement = m_placement;
+  }
+
+  return detail::pick_worker(placement, m_all.data(), m_all.size(),
+                             detail::NO_LOCAL_WORKER, m_rng, m_round_robin);
+}
+
+void Runtime::init_shards() {
+  const auto n = m_workers.size();
+  m_shard_queues = std::make_unique<SpscQueue[]>(n * n);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto links = std::make_unique<ShardLinks>();
+    links->id = i;
+    links->out.resize(n, nullptr);
+    links->in.resize(n, nullptr);
+    for (std::size_t j = 0; j < n; ++j) {
+      links->shards.emplace_back(&m_workers[j].worker);
+      if (j != i) {
+        links->out[j] = &m_shard_queues[i * n + j];
+        links->in[j] = &m_shard_queues[j * n + i];
+      }
+    }
+
+    m_workers[i].worker.set_shard(links.get());
+    m_shard_links.emplace_back(std::move(links));
+  }
+}
+
 std::vector<Worker*> Runtime::workers_for(std::size_t id) {
   std::vector<Worker*> workers;
   for (std::size_t i = 0; i < m_workers.size(); ++i) {
@@ -39,7 +87,38 @@ std::vector<Worker*> Runtime::workers_for(std::size_t id) {
   return workers;
 }
 
+RuntimeMetrics Runtime::metrics() const {
+  RuntimeMetrics metrics;
+  metrics.workers.reserve(m_workers.size());
+  for (const auto& state : m_workers) {
+    metrics.workers.emplace_back(state.worker.metrics());
+    metrics.total.merge(metrics.workers.back());
+  }
+  return metrics;
+}
+
+void Runtime::dump_trace(std::ostream& out) const {
+  std::vector<std::vector<TraceEvent>> events;
+  events.reserve(m_workers.size());
+  for (const auto& state : m_workers) {
+    events.emplace_back(state.worker.trace());
+  }
+  write_chrome_trace(out, events);
+}
+
 void Runtime::run() noexcept {
+  for (std::size_t i = 0; i < m_workers.size(); ++i) {
+    m_workers[i].worker.set_peers(m_all, i, m_placement);
+  }
+
+  if (m_watchdog_config) {
+    std::vector<Worker*> workers;
+    for (auto& state : m_workers) {
+      workers.emplace_back(&state.worker);
+    }
+    m_watchdog = std::make_unique<Watchdog>(*m_watchdog_config, std::move(workers));
+  }
+
   for (std::size_t i = 1; i < m_workers.size(); ++i) {
     auto* state = &m_workers[i];
     assert(!state->thread.joinable());
@@ -1,41 +1,95 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <source_location>
 #include <thread>
 #include <vector>
 
+#include "blocking_pool.hpp"
+#include "co_task.hpp"
+#include "metrics.hpp"
 #include "result.hpp"
 #include "random.hpp"
+#include "shard.hpp"
+#include "watchdog.hpp"
 #include "worker.hpp"
 
 
 namespace rt {
 
+struct RuntimeConfig {
+  // 0 threads means use number of cores
+  std::size_t n_threads{0};
+  // limits of the pool used by spawn_blocking()
+  BlockingPool::Config blocking{};
+  // stall watchdog is started by run() if set
+  std::optional<WatchdogConfig> watchdog{};
+  // Thread-per-core mode: workers never steal from each other, tasks
+  // running on different workers (shards) communicate only through
+  // submit_to(). Each shard should use its own sockets.
+  bool sharded{false};
+  // used by Runtime::spawn() and spawns with Placement::runtime_default()
+  Placement placement{Placement::random()};
+};
+
 class Runtime {
  public:
   // 0 threads means use number of cores
   static Result<Runtime> create(std::size_t n_threads = 0);
+  static Result<Runtime> create(const RuntimeConfig& config);
 
+  // NOTE: when called from a task, it's queued through the task's worker,
+  //       otherwise it's only safe to call before run()
   template <typename F>
-  void spawn(F&& fn) {
-    const auto idx = m_rng.gen() % m_workers.size();
-    auto& state = m_workers[idx];
-    state.worker.spawn(std::forward<F>(fn));
+  void spawn(F&& fn, Priority priority = Priority::Normal,
+             Placement placement = Placement::runtime_default(),
+             std::source_location location = std::source_location::current()) {
+    if (auto* task = current_task()) {
+      task->owner->spawn(std::forward<F>(fn), priority, placement, location);
+      return;
+    }
+
+    auto& state = m_workers[pick(placement)];
+    state.worker.spawn(std::forward<F>(fn), priority, Placement::local(), location);
     // FIXME: wake up worker if it's sleeping
   }
 
+  void spawn(co_task<void>&& task, Priority priority = Priority::Normal,
+             Placement placement = Placement::runtime_default(),
+             std::source_location location = std::source_location::current()) {
+    if (auto* current = current_task()) {
+      current->owner->spawn_coroutine(task.release(), priority, placement, location);
+      return;
+    }
+
+    auto& state = m_workers[pick(placement)];
+    state.worker.spawn_coroutine(task.release(), priority, Placement::local(), location);
+  }
+
   void run() noexcept;
 
+  // snapshot of all workers' metrics, safe to call from any thread
+  RuntimeMetrics metrics() const;
+  // writes events recorded by all workers since rt::set_tracing(true) in
+  // Chrome trace format, safe to call from any thread
+  void dump_trace(std::ostream& out) const;
+
  private:
   Runtime() = default;
   std::vector<Worker*> workers_for(std::size_t id);
+  void init_shards();
+  std::size_t pick(Placement placement) noexcept;
 
   struct WorkerState {
     std::thread thread{};
     std::atomic<bool> awake{false};
     Worker worker;
 
-    WorkerState(IoEngine io) : worker(std::move(io)) {}
+    WorkerState(IoEngine io, BlockingPool* blocking)
+        : worker(std::move(io), blocking) {}
     WorkerState(WorkerState&& other) noexcept
         : thread(std::move(other.thread)),
           awake(other.awake.load()),
@@ -43,7 +97,17 @@ class Runtime {
   };
 
   XorShiftRng m_rng;
+  Placement m_placement{};
+  std::size_t m_round_robin{0};
+  std::vector<Worker*> m_all;  // points into m_workers
+  // NOTE: declared before m_workers, since workers refer to them
+  std::unique_ptr<BlockingPool> m_blocking;
+  std::unique_ptr<SpscQueue[]> m_shard_queues;  // n * n, [from * n + to]
+  std::vector<std::unique_ptr<ShardLinks>> m_shard_links;
   std::vector<WorkerState> m_workers;
+  std::optional<WatchdogConfig> m_watchdog_config;
+  // NOTE: declared after m_workers, since it refers to them
+  std::unique_ptr<Watchdog> m_watchdog;
 };
 
 
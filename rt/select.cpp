@@ -0,0 +1,158 @@
+#include "select.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "task.hpp"
+#include "worker.hpp"
+
+namespace rt {
+
+static std::error_code os_error(DWORD value) {
+  return {static_cast<int>(value), std::system_category()};
+}
+
+Result<std::size_t> IoSelect::acquire(Socket& s) noexcept {
+  std::lock_guard lock(m_mutex);
+  for (std::size_t i = 0; i < MAX_OPS; ++i) {
+    auto& slot = m_slots[i];
+    if (slot.state != SlotState::Free) {
+      continue;
+    }
+
+    slot.op = IoOp{current_task()};
+    slot.op.select = this;
+    slot.socket = &s;
+    slot.state = SlotState::Pending;
+    ++m_n_pending;
+    return i;
+  }
+
+  return os_error(ERROR_NOT_FOUND);
+}
+
+Result<std::size_t> IoSelect::recv(Socket& s, char* data, std::size_t n) noexcept {
+  auto slot = acquire(s);
+  if (!slot) {
+    return slot;
+  }
+
+  const IoSliceMut buffer{data, n};
+  auto* io = current_task()->owner->io();
+  if (auto e = io->start_recv(&m_slots[*slot].op, &s, &buffer, 1)) {
+    std::lock_guard lock(m_mutex);
+    m_slots[*slot].state = SlotState::Free;
+    --m_n_pending;
+    return e;
+  }
+
+  return slot;
+}
+
+Result<std::size_t> IoSelect::send(Socket& s, const char* data,
+                                   std::size_t n) noexcept {
+  auto slot = acquire(s);
+  if (!slot) {
+    return slot;
+  }
+
+  const IoSlice buffer{data, n};
+  auto* io = current_task()->owner->io();
+  if (auto e = io->start_send(&m_slots[*slot].op, &s, &buffer, 1)) {
+    std::lock_guard lock(m_mutex);
+    m_slots[*slot].state = SlotState::Free;
+    --m_n_pending;
+    return e;
+  }
+
+  return slot;
+}
+
+std::size_t IoSelect::pending() const noexcept {
+  std::lock_guard lock(m_mutex);
+  std::size_t n = 0;
+  for (const auto& slot : m_slots) {
+    n += slot.state != SlotState::Free;
+  }
+  return n;
+}
+
+void IoSelect::park(std::unique_lock<std::mutex>& lock) noexcept {
+  auto* task = current_task();
+  // NOTE: the completion may be dequeued by another worker, so the wake up
+  //       is posted to the worker we park on, which can't run us before
+  //       we're switched out
+  m_wake = IoOp{task};
+  m_engine = task->owner->io();
+  m_waiting = true;
+  lock.unlock();
+  task->block_on_io();
+  lock.lock();
+}
+
+Result<IoSelect::Completion> IoSelect::wait_any() noexcept {
+  std::unique_lock lock(m_mutex);
+  bool parked = false;
+  while (true) {
+    for (std::size_t i = 0; i < MAX_OPS; ++i) {
+      const auto index = (m_next + i) % MAX_OPS;
+      auto& slot = m_slots[index];
+      if (slot.state != SlotState::Done) {
+        continue;
+      }
+
+      slot.state = SlotState::Free;
+      slot.socket = nullptr;
+      m_next = index + 1;
+      Completion completion{index, IoEngine::transferred(slot.op)};
+      lock.unlock();
+      if (!parked) {
+        consume_budget();
+      }
+      return completion;
+    }
+
+    if (m_n_pending == 0) {
+      return os_error(ERROR_NOT_FOUND);
+    }
+
+    park(lock);
+    parked = true;
+  }
+}
+
+void IoSelect::cancel() noexcept {
+  std::unique_lock lock(m_mutex);
+  for (auto& slot : m_slots) {
+    if (slot.state == SlotState::Pending) {
+      // NOTE: fails if the operation has just completed, its completion is
+      //       still delivered
+      ::CancelIoEx(slot.socket->handle(), &slot.op);
+    }
+  }
+
+  while (m_n_pending != 0) {
+    park(lock);
+  }
+
+  for (auto& slot : m_slots) {
+    slot.state = SlotState::Free;
+    slot.socket = nullptr;
+  }
+}
+
+void IoSelect::complete(IoOp* op) noexcept {
+  std::lock_guard lock(m_mutex);
+  auto* slot = std::find_if(std::begin(m_slots), std::end(m_slots),
+                            [op](const Slot& s) { return &s.op == op; });
+  assert(slot != std::end(m_slots) && slot->state == SlotState::Pending);
+  slot->state = SlotState::Done;
+  --m_n_pending;
+  if (m_waiting) {
+    m_waiting = false;
+    m_engine->notify(&m_wake);
+  }
+}
+
+}  // namespace rt
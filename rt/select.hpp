@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "io_engine.hpp"
+#include "result.hpp"
+#include "socket.hpp"
+
+namespace rt {
+
+// Issues several operations from one task and waits for whichever completes
+// first, the others stay pending and are taken by following wait_any()
+// calls. Completions of operations nobody waits for are only recorded, so
+// the task can do other IO in between (e.g. a proxy sending what it received
+// while a recv from the other side is still pending).
+// NOTE: stackful tasks only, sockets and buffers should outlive operations
+//       issued on them
+class IoSelect {
+ public:
+  static constexpr std::size_t MAX_OPS = 8;
+
+  struct Completion {
+    std::size_t slot;
+    Result<std::size_t> result;  // bytes transferred
+  };
+
+  IoSelect() noexcept = default;
+  IoSelect(const IoSelect&) = delete;
+  IoSelect& operator=(const IoSelect&) = delete;
+  ~IoSelect() noexcept { cancel(); }
+
+  // return slot of the started operation, fails with ERROR_NOT_FOUND when all
+  // slots are busy
+  Result<std::size_t> recv(Socket& s, char* data, std::size_t n) noexcept;
+  Result<std::size_t> send(Socket& s, const char* data, std::size_t n) noexcept;
+
+  // number of operations which weren't taken by wait_any() yet
+  std::size_t pending() const noexcept;
+  // takes a completed operation, parks the task only if there is none. Slots
+  // are scanned round robin, so a busy one can't starve the rest. Fails with
+  // ERROR_NOT_FOUND if there is nothing to wait for.
+  Result<Completion> wait_any() noexcept;
+  // cancels pending operations and waits until the kernel is done with
+  // them, their results are discarded
+  void cancel() noexcept;
+
+  // called by IoEngine::wait() for completions of operations issued here
+  void complete(IoOp* op) noexcept;
+
+ private:
+  enum class SlotState : std::uint8_t {
+    Free,
+    Pending,
+    Done,
+  };
+
+  struct Slot {
+    Slot() noexcept : op(nullptr) {}
+
+    IoOp op;
+    Socket* socket{nullptr};
+    SlotState state{SlotState::Free};
+  };
+
+  Result<std::size_t> acquire(Socket& s) noexcept;
+  void park(std::unique_lock<std::mutex>& lock) noexcept;
+
+  mutable std::mutex m_mutex;  // completions may be dequeued by other workers
+  Slot m_slots[MAX_OPS];
+  std::size_t m_n_pending{0};  // issued and not completed
+  std::size_t m_next{0};       // where wait_any() starts scanning
+  bool m_waiting{false};
+  IoEngine* m_engine{nullptr};  // of the worker the task is parked on
+  IoOp m_wake{nullptr};
+};
+
+}  // namespace rt
@@ -0,0 +1,53 @@
+#include "shard.hpp"
+
+#include <thread>
+
+
+namespace rt {
+
+std::size_t shard_id() noexcept {
+  auto* links = current_task()->owner->shard();
+  assert(links && "runtime is not in shard mode");
+  return links->id;
+}
+
+std::size_t shard_count() noexcept {
+  auto* links = current_task()->owner->shard();
+  assert(links && "runtime is not in shard mode");
+  return links->shards.size();
+}
+
+namespace detail {
+
+static void wake_if_sleeping(Worker* target) noexcept {
+  if (target->shard()->sleeping.load(std::memory_order_relaxed)) {
+    target->io()->wake();
+  }
+}
+
+void send_to_shard(std::size_t shard, ShardMessage* msg) noexcept {
+  auto& w = *current_task()->owner;
+  auto* links = w.shard();
+  assert(links && "runtime is not in shard mode");
+  if (shard == links->id) {
+    msg->run(w);
+    return;
+  }
+
+  auto* target = links->shards[shard];
+  auto* queue = links->out[shard];
+  while (!queue->push(msg)) {
+    // target is behind, keep draining our own queues meanwhile, so two
+    // shards sending to each other can't get stuck
+    wake_if_sleeping(target);
+    w.poll_shard();
+    std::this_thread::yield();
+  }
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  wake_if_sleeping(target);
+}
+
+}  // namespace detail
+
+} // namespace rt
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <source_location>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "task.hpp"
+#include "worker.hpp"
+
+
+namespace rt {
+
+namespace detail {
+
+struct ShardMessage {
+  virtual ~ShardMessage() = default;
+  // called by the worker which popped the message
+  virtual void run(Worker& w) noexcept = 0;
+};
+
+}  // namespace detail
+
+// Bounded lock-free single producer single consumer queue of messages
+// between a pair of shards
+class SpscQueue {
+ public:
+  static constexpr std::size_t CAPACITY = 256;
+
+  // returns false if full, producer only
+  bool push(detail::ShardMessage* msg) noexcept {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cached_head == CAPACITY) {
+      m_cached_head = m_head.load(std::memory_order_acquire);
+      if (tail - m_cached_head == CAPACITY) {
+        return false;
+      }
+    }
+
+    m_slots[tail % CAPACITY] = msg;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // returns nullptr if empty, consumer only
+  detail::ShardMessage* pop() noexcept {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cached_tail) {
+      m_cached_tail = m_tail.load(std::memory_order_acquire);
+      if (head == m_cached_tail) {
+        return nullptr;
+      }
+    }
+
+    auto* msg = m_slots[head % CAPACITY];
+    m_head.store(head + 1, std::memory_order_release);
+    return msg;
+  }
+
+ private:
+  // NOTE: producer and consumer fields are on separate cache lines
+  alignas(64) std::atomic<std::size_t> m_tail{0};
+  std::size_t m_cached_head{0};
+  alignas(64) std::atomic<std::size_t> m_head{0};
+  std::size_t m_cached_tail{0};
+  alignas(64) detail::ShardMessage* m_slots[CAPACITY]{};
+};
+
+// Links of a single shard to all other shards, owned by Runtime
+struct ShardLinks {
+  std::size_t id{0};
+  std::vector<Worker*> shards;    // all shards, indexed by id
+  std::vector<SpscQueue*> out;    // to shard i, nullptr for self
+  std::vector<SpscQueue*> in;     // from shard i, nullptr for self
+  std::atomic<bool> sleeping{false};  // set while blocked in IoEngine::wait()
+};
+
+namespace detail {
+
+void send_to_shard(std::size_t shard, ShardMessage* msg) noexcept;
+
+template <typename T>
+struct ShardResult : ShardMessage {
+  using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+  std::size_t origin{0};
+  std::source_location location{};
+  std::optional<Value> value;
+  bool finished{false};  // set by the target shard before sending it back
+  bool done{false};      // the rest is touched only by the origin shard
+  bool detached{false};
+  Task* waiter{nullptr};
+
+  T take() {
+    if constexpr (!std::is_void_v<T>) {
+      return std::move(*value);
+    }
+  }
+};
+
+template <typename F, typename T>
+struct ShardCall final : ShardResult<T> {
+  template <typename Fn>
+  explicit ShardCall(Fn&& f) : fn(std::forward<Fn>(f)) {}
+
+  void run(Worker& w) noexcept override;
+
+  F fn;
+};
+
+}  // namespace detail
+
+// Result of submit_to(), join() or co_await it exactly once. If dropped
+// before the call completes, the result is discarded.
+// NOTE: belongs to the shard which submitted the call
+template <typename T>
+class ShardHandle {
+ public:
+  explicit ShardHandle(detail::ShardResult<T>* call) noexcept : m_call(call) {}
+  ShardHandle(const ShardHandle&) = delete;
+  ShardHandle(ShardHandle&& other) noexcept : m_call(std::exchange(other.m_call, nullptr)) {}
+  ShardHandle& operator=(const ShardHandle&) = delete;
+  ShardHandle& operator=(ShardHandle&&) = delete;
+  ~ShardHandle() {
+    if (!m_call) {
+      return;
+    }
+
+    if (m_call->done) {
+      delete m_call;
+    } else {
+      m_call->detached = true;
+    }
+  }
+
+  bool done() const noexcept { return m_call->done; }
+
+  // parks the current stackful task until the call completes
+  T join() {
+    if (!m_call->done) {
+      auto* task = current_task();
+      m_call->waiter = task;
+      task->park();
+    }
+    return take();
+  }
+
+  bool await_ready() const noexcept { return m_call->done; }
+  void await_suspend(std::coroutine_handle<> h) noexcept {
+    auto* task = current_task();
+    task->coroutine = h;
+    m_call->waiter = task;
+    task->suspend_park();
+  }
+  T await_resume() { return take(); }
+
+ private:
+  T take() {
+    std::unique_ptr<detail::ShardResult<T>> call{std::exchange(m_call, nullptr)};
+    return call->take();
+  }
+
+  detail::ShardResult<T>* m_call;
+};
+
+// Index of the current shard and number of shards, valid only in shard mode
+// (see RuntimeConfig::sharded)
+std::size_t shard_id() noexcept;
+std::size_t shard_count() noexcept;
+
+// Runs fn as a new task on the given shard. The call and its result travel
+// over SPSC queues between the two shards, the current task keeps running
+// until it joins the result.
+template <typename F>
+auto submit_to(std::size_t shard, F&& fn,
+               std::source_location location = std::source_location::current()) {
+  using Fn = std::decay_t<F>;
+  using T = std::invoke_result_t<Fn&>;
+  auto* call = new detail::ShardCall<Fn, T>(std::forward<F>(fn));
+  call->origin = shard_id();
+  call->location = location;
+  detail::send_to_shard(shard, call);
+  return ShardHandle<T>{call};
+}
+
+namespace detail {
+
+template <typename F, typename T>
+void ShardCall<F, T>::run(Worker& w) noexcept {
+  if (!this->finished) {
+    // on the target shard
+    w.spawn(
+        [this] {
+          if constexpr (std::is_void_v<T>) {
+            fn();
+            this->value.emplace();
+          } else {
+            this->value.emplace(fn());
+          }
+          this->finished = true;
+          send_to_shard(this->origin, this);
+        },
+        Priority::Normal, Placement::local(), this->location);
+    return;
+  }
+
+  // back on the origin shard
+  this->done = true;
+  if (this->detached) {
+    delete this;
+    return;
+  }
+
+  if (auto* task = std::exchange(this->waiter, nullptr)) {
+    w.wake(task);
+  }
+}
+
+}  // namespace detail
+
+} // namespace rt
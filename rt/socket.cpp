@@ -1,7 +1,12 @@
 #include "socket.hpp"
+#include "file.hpp"
 #include "worker.hpp"
 #include "task.hpp"
 
+#include <afunix.h>
+
+#include <cstring>
+
 
 namespace rt {
 
@@ -25,15 +30,62 @@ static std::error_code last_socket_error() {
 }
 
 
-Result<Socket> Socket::create() noexcept {
+namespace detail {
+
+sockaddr_in to_sockaddr(IpAddr ip, Port port) noexcept {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = to_be(ip);
+  addr.sin_port = to_be(port);
+  return addr;
+}
+
+void from_sockaddr(const sockaddr_in& addr, IpAddr& ip, Port& port) noexcept {
+  const auto raw = static_cast<std::uint32_t>(addr.sin_addr.s_addr);
+  ip = {static_cast<std::uint8_t>(raw >> 0), static_cast<std::uint8_t>(raw >> 8),
+        static_cast<std::uint8_t>(raw >> 16), static_cast<std::uint8_t>(raw >> 24)};
+  port = to_be(static_cast<std::uint16_t>(addr.sin_port));
+}
+
+}  // namespace detail
+
+Result<Socket> Socket::create(Protocol protocol) noexcept {
   // TODO: support ipv6
-  // TODO: support udp
-  Socket s{::WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0,
+  const bool udp = protocol == Protocol::Udp;
+  if (protocol == Protocol::Unix) {
+    Socket s{::WSASocket(AF_UNIX, SOCK_STREAM, 0, NULL, 0, WSA_FLAG_OVERLAPPED)};
+    if (!s.valid()) {
+      return last_socket_error();
+    }
+    s.m_family = AF_UNIX;
+    return s;
+  }
+
+  Socket s{::WSASocket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM,
+                       udp ? IPPROTO_UDP : IPPROTO_TCP, NULL, 0,
                        WSA_FLAG_OVERLAPPED)};
   if (!s.valid()) {
     return last_socket_error();
   }
 
+  if (udp) {
+    // batched recv/send drain socket buffers with non-overlapped calls,
+    // these should never block
+    u_long non_blocking = 1;
+    if (::ioctlsocket(s.m_socket, FIONBIO, &non_blocking) != 0) {
+      return last_socket_error();
+    }
+
+    // otherwise ICMP "port unreachable" for one of previously sent datagrams
+    // fails the next recv with WSAECONNRESET
+    BOOL report_reset = FALSE;
+    DWORD bytes = 0;
+    if (::WSAIoctl(s.m_socket, SIO_UDP_CONNRESET, &report_reset,
+                   sizeof(report_reset), NULL, 0, &bytes, NULL, NULL) != 0) {
+      return last_socket_error();
+    }
+  }
+
   return s;
 }
 
@@ -43,17 +95,13 @@ Result<Socket> Socket::bind(IpAddr ip, Port port) noexcept {
     return s;
   }
 
-  sockaddr_in addr{};
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = to_be(ip);
-  addr.sin_port = to_be(port);
-
+  auto addr = detail::to_sockaddr(ip, port);
   int status = ::bind(s->m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
   if (status) {
     return last_socket_error();
   }
 
-  status = ::listen(s->m_socket, 5);
+  status = ::listen(s->m_socket, SOMAXCONN);
   if (status) {
     return last_socket_error();
   }
@@ -61,10 +109,141 @@ Result<Socket> Socket::bind(IpAddr ip, Port port) noexcept {
   return s;
 }
 
+Result<Socket> Socket::connect(IpAddr ip, Port port) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->connect(task, ip, port);
+}
+
+Result<Socket> Socket::bind_udp(IpAddr ip, Port port) noexcept {
+  auto s = Socket::create(Protocol::Udp);
+  if (!s) {
+    return s;
+  }
+
+  auto addr = detail::to_sockaddr(ip, port);
+  if (::bind(s->m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+    return last_socket_error();
+  }
+
+  return s;
+}
+
+static std::error_code to_unix_addr(const char* path, SOCKADDR_UN& addr) {
+  const auto len = std::strlen(path);
+  if (len >= sizeof(addr.sun_path)) {
+    return socket_error(WSAENAMETOOLONG);
+  }
+
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path, len);
+  return {};
+}
+
+Result<Socket> Socket::bind_unix(const char* path) noexcept {
+  SOCKADDR_UN addr;
+  if (auto e = to_unix_addr(path, addr)) {
+    return e;
+  }
+
+  auto s = Socket::create(Protocol::Unix);
+  if (!s) {
+    return s;
+  }
+
+  if (::bind(s->m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+    return last_socket_error();
+  }
+
+  if (::listen(s->m_socket, SOMAXCONN)) {
+    return last_socket_error();
+  }
+
+  return s;
+}
+
+Result<Socket> Socket::connect_unix(const char* path) noexcept {
+  SOCKADDR_UN addr;
+  if (auto e = to_unix_addr(path, addr)) {
+    return e;
+  }
+
+  auto s = Socket::create(Protocol::Unix);
+  if (!s) {
+    return s;
+  }
+
+  // NOTE: ConnectEx() needs a bound socket, which for AF_UNIX means a
+  //       socket file of its own. A blocking connect() is run on the blocking
+  //       pool instead, it parks only the calling task while the listener's
+  //       backlog is full.
+  const SOCKET raw = s->m_socket;
+  const int error = spawn_blocking([raw, &addr]() noexcept {
+    if (::connect(raw, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+      return ::WSAGetLastError();
+    }
+    return 0;
+  });
+  if (error != 0) {
+    return socket_error(static_cast<DWORD>(error));
+  }
+
+  return s;
+}
+
+std::error_code Socket::send_socket(Socket& s) noexcept {
+  // NOTE: there are no SCM_RIGHTS on Windows, the socket is duplicated for
+  //       the peer process and the description of the duplicate is sent
+  //       as regular data
+  DWORD pid = 0;
+  DWORD bytes = 0;
+  if (::WSAIoctl(m_socket, SIO_AF_UNIX_GETPEERPID, NULL, 0, &pid, sizeof(pid),
+                 &bytes, NULL, NULL) != 0) {
+    return last_socket_error();
+  }
+
+  if (s.m_engine) {
+    s.m_engine->remove(s.handle());
+    s.m_engine = nullptr;
+  }
+
+  WSAPROTOCOL_INFOW info{};
+  if (::WSADuplicateSocketW(s.m_socket, pid, &info) != 0) {
+    return last_socket_error();
+  }
+
+  return send_all(reinterpret_cast<const char*>(&info), sizeof(info));
+}
+
+Result<Socket> Socket::recv_socket() noexcept {
+  WSAPROTOCOL_INFOW info{};
+  auto* data = reinterpret_cast<char*>(&info);
+  std::size_t received = 0;
+  while (received < sizeof(info)) {
+    const auto n = recv(data + received, sizeof(info) - received);
+    if (auto e = n.err()) {
+      return e;
+    }
+
+    if (*n == 0) {
+      return socket_error(ERROR_HANDLE_EOF);
+    }
+    received += *n;
+  }
+
+  Socket s{::WSASocketW(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO,
+                        FROM_PROTOCOL_INFO, &info, 0, WSA_FLAG_OVERLAPPED)};
+  if (!s.valid()) {
+    return last_socket_error();
+  }
+
+  s.m_family = info.iAddressFamily;
+  return s;
+}
+
 void Socket::close() noexcept {
   if (valid()) {
     closesocket(m_socket);
-    m_task = nullptr;
     m_engine = nullptr;
     m_socket = INVALID_SOCKET;
   }
@@ -98,14 +277,84 @@ std::error_code Socket::send_all(const char* data, std::size_t n) noexcept {
   return {};
 }
 
+Result<std::size_t> Socket::send_vectored(const IoSlice* slices,
+                                          std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->send_vectored(task, this, slices, n);
+}
+
+std::error_code Socket::send_all_vectored(IoSlice* slices, std::size_t n) noexcept {
+  while (n != 0) {
+    if (slices->size == 0) {
+      ++slices;
+      --n;
+      continue;
+    }
+
+    const auto s = send_vectored(slices, n);
+    if (auto e = s.err()) {
+      return e;
+    }
+
+    if (*s == 0) {
+      return std::error_code(WSAECONNRESET, std::system_category());
+    }
+
+    auto sent = *s;
+    while (sent != 0) {
+      const auto k = (std::min)(sent, slices->size);
+      slices->data += k;
+      slices->size -= k;
+      sent -= k;
+      if (slices->size == 0) {
+        ++slices;
+        --n;
+      }
+    }
+  }
+
+  return {};
+}
+
 Result<std::size_t> Socket::recv(char* data, std::size_t n) noexcept {
   auto* task = current_task();
   return task->owner->io()->recv(task, this, data, n);
 }
 
+Result<std::size_t> Socket::recv_vectored(const IoSliceMut* slices,
+                                          std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->recv_vectored(task, this, slices, n);
+}
+
 std::error_code Socket::shutdown() noexcept {
   auto* task = current_task();
   return task->owner->io()->shutdown(task, this);
 }
 
+std::error_code Socket::shutdown_send() noexcept {
+  // NOTE: shutdown() uses DisconnectEx(), which closes both directions
+  if (::shutdown(m_socket, SD_SEND) != 0) {
+    return last_socket_error();
+  }
+
+  return {};
+}
+
+Result<std::size_t> Socket::recv_batch(Datagram* msgs, std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->recv_batch(task, this, msgs, n);
+}
+
+Result<std::size_t> Socket::send_batch(const Datagram* msgs, std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->send_batch(task, this, msgs, n);
+}
+
+Result<std::size_t> Socket::sendfile(File& f, std::uint64_t offset,
+                                     std::size_t n) noexcept {
+  auto* task = current_task();
+  return task->owner->io()->sendfile(task, this, &f, offset, n);
+}
+
 } // namespace rt
\ No newline at end of file
@@ -6,17 +6,52 @@
 #include <winsock2.h>
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 
 namespace rt {
 
+class File;
 class IoEngine;
 struct Task;
 
 using IpAddr = std::array<std::uint8_t, 4>;
 using Port = std::uint16_t;
 
+enum class Protocol {
+  Tcp,
+  Udp,
+  Unix,  // AF_UNIX stream
+};
+
+struct IoSlice {
+  const char* data{nullptr};
+  std::size_t size{0};
+};
+
+struct IoSliceMut {
+  char* data{nullptr};
+  std::size_t size{0};
+};
+
+// A slot for a single datagram in batched send/recv
+struct Datagram {
+  char* data{nullptr};
+  std::size_t capacity{0};  // size of the data buffer, used only by recv
+  std::size_t size{0};      // number of bytes to send or bytes received
+  IpAddr ip{};              // destination or source address
+  Port port{0};
+  bool truncated{false};    // set by recv if datagram didn't fit into capacity
+};
+
+namespace detail {
+
+sockaddr_in to_sockaddr(IpAddr ip, Port port) noexcept;
+void from_sockaddr(const sockaddr_in& addr, IpAddr& ip, Port& port) noexcept;
+
+}  // namespace detail
+
 class Socket {
  public:
   friend class IoEngine;
@@ -25,10 +60,11 @@ class Socket {
   Socket(SOCKET s) noexcept : m_socket(s) {}
   Socket(const Socket&) = delete;
   Socket(Socket&& other) noexcept
-      : m_task{other.m_task},
-        m_engine(other.m_engine),
-        m_socket{other.m_socket} {
-    other.m_task = nullptr;
+      : m_engine(other.m_engine),
+        m_socket{other.m_socket},
+        m_family(other.m_family),
+        m_recv_error(other.m_recv_error),
+        m_send_error(other.m_send_error) {
     other.m_engine = nullptr;
     other.m_socket = INVALID_SOCKET;
   }
@@ -39,31 +75,72 @@ class Socket {
     }
 
     close();
-    std::swap(m_task, other.m_task);
     std::swap(m_engine, other.m_engine);
     std::swap(m_socket, other.m_socket);
+    std::swap(m_family, other.m_family);
+    std::swap(m_recv_error, other.m_recv_error);
+    std::swap(m_send_error, other.m_send_error);
     return *this;
   }
   ~Socket() noexcept { close(); }
 
   static Result<Socket> bind(IpAddr ip, Port port) noexcept;
+  static Result<Socket> connect(IpAddr ip, Port port) noexcept;
+  // creates unconnected datagram socket
+  static Result<Socket> bind_udp(IpAddr ip, Port port) noexcept;
+  // AF_UNIX stream sockets, bind creates the socket file, which should not
+  // exist yet
+  static Result<Socket> bind_unix(const char* path) noexcept;
+  static Result<Socket> connect_unix(const char* path) noexcept;
 
   bool valid() const noexcept { return m_socket != INVALID_SOCKET; }
   void close() noexcept;
   Handle handle() const noexcept { return reinterpret_cast<Handle>(m_socket); }
+  int family() const noexcept { return m_family; }
 
   Result<Socket> accept() noexcept;
   Result<std::size_t> send(const char* data, std::size_t n) noexcept;
   std::error_code send_all(const char* data, std::size_t n) noexcept;
+  Result<std::size_t> send_vectored(const IoSlice* slices, std::size_t n) noexcept;
+  // NOTE: slices are modified to track progress
+  std::error_code send_all_vectored(IoSlice* slices, std::size_t n) noexcept;
   Result<std::size_t> recv(char* data, std::size_t n) noexcept;
+  Result<std::size_t> recv_vectored(const IoSliceMut* slices, std::size_t n) noexcept;
   std::error_code shutdown() noexcept;
+  // half-close, the peer receives EOF but can still send, doesn't park
+  std::error_code shutdown_send() noexcept;
+
+  // UDP only. Fills up to n slots with datagrams that are already queued,
+  // parks the task only if there are none. Returns number of filled slots.
+  // NOTE: datagrams are still received one system call each, only parking
+  //       is amortized. An error hit after some datagrams were received is
+  //       returned by the next call, same for send_batch().
+  Result<std::size_t> recv_batch(Datagram* msgs, std::size_t n) noexcept;
+  // UDP only. Returns number of sent datagrams, parks the task only when
+  // socket send buffer is full.
+  Result<std::size_t> send_batch(const Datagram* msgs, std::size_t n) noexcept;
+  // sends n bytes of file starting at offset without copying them through
+  // user space, returns number of bytes sent
+  Result<std::size_t> sendfile(File& f, std::uint64_t offset, std::size_t n) noexcept;
+
+  // AF_UNIX only. Hands a duplicate of s (a connection or a listener) to the
+  // process on the other end, which takes it with recv_socket(). s itself
+  // stays open, but it's detached from its IoEngine, since the duplicate
+  // shares the completion port association and couldn't be registered by
+  // the receiving process otherwise.
+  // NOTE: s should have no operations in flight
+  std::error_code send_socket(Socket& s) noexcept;
+  Result<Socket> recv_socket() noexcept;
 
  private:
-  static Result<Socket> create() noexcept;
+  static Result<Socket> create(Protocol protocol = Protocol::Tcp) noexcept;
 
-  Task* m_task{nullptr};
   IoEngine* m_engine{nullptr};
   SOCKET m_socket{INVALID_SOCKET};
+  int m_family{AF_INET};
+  // errors of batched calls which returned a partial batch
+  std::error_code m_recv_error{};
+  std::error_code m_send_error{};
 };
 
 
@@ -0,0 +1,105 @@
+#include "splice.hpp"
+
+#include <algorithm>
+#include <memory>
+
+#include "select.hpp"
+
+namespace rt {
+
+// NOTE: Windows can't move data between sockets in the kernel (TransmitFile()
+//       takes only files), so data is received straight into this buffer and
+//       sent from it, without any other copies
+static constexpr std::size_t SPLICE_BUFFER_SIZE = 16 * 1024;
+
+Result<std::size_t> splice(Socket& from, Socket& to, std::size_t max) noexcept {
+  auto buffer = std::make_unique_for_overwrite<char[]>(SPLICE_BUFFER_SIZE);
+  std::size_t moved = 0;
+  while (moved < max) {
+    const auto n = from.recv(buffer.get(), (std::min)(SPLICE_BUFFER_SIZE, max - moved));
+    if (auto e = n.err()) {
+      return e;
+    }
+
+    if (*n == 0) {
+      break;
+    }
+
+    if (auto e = to.send_all(buffer.get(), *n)) {
+      return e;
+    }
+    moved += *n;
+  }
+
+  return moved;
+}
+
+Result<Relayed> copy_bidirectional(Socket& a, Socket& b) noexcept {
+  struct Direction {
+    Socket* from;
+    Socket* to;
+    std::uint64_t* relayed;
+    std::unique_ptr<char[]> buffer;
+    std::size_t slot{0};  // of the pending receive
+    bool open{true};
+  };
+
+  Relayed relayed;
+  Direction directions[2] = {
+      {&a, &b, &relayed.a_to_b, std::make_unique_for_overwrite<char[]>(SPLICE_BUFFER_SIZE)},
+      {&b, &a, &relayed.b_to_a, std::make_unique_for_overwrite<char[]>(SPLICE_BUFFER_SIZE)},
+  };
+
+  // NOTE: destroyed before directions, pending receives are cancelled
+  //       before their buffers are freed
+  IoSelect select;
+  for (auto& d : directions) {
+    auto slot = select.recv(*d.from, d.buffer.get(), SPLICE_BUFFER_SIZE);
+    if (auto e = slot.err()) {
+      return e;
+    }
+    d.slot = *slot;
+  }
+
+  std::size_t open = 2;
+  while (open != 0) {
+    auto completion = select.wait_any();
+    if (auto e = completion.err()) {
+      return e;
+    }
+
+    auto& d = directions[0].open && directions[0].slot == completion->slot
+                  ? directions[0]
+                  : directions[1];
+    const auto& n = completion->result;
+    if (auto e = n.err()) {
+      return e;
+    }
+
+    if (*n == 0) {
+      // forward EOF, the other direction keeps relaying
+      if (auto e = d.to->shutdown_send()) {
+        return e;
+      }
+      d.open = false;
+      --open;
+      continue;
+    }
+
+    // the other direction's receive stays pending meanwhile
+    if (auto e = d.to->send_all(d.buffer.get(), *n)) {
+      return e;
+    }
+    *d.relayed += *n;
+
+    auto slot = select.recv(*d.from, d.buffer.get(), SPLICE_BUFFER_SIZE);
+    if (auto e = slot.err()) {
+      return e;
+    }
+    d.slot = *slot;
+  }
+
+  return relayed;
+}
+
+}  // namespace rt
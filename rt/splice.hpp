@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "result.hpp"
+#include "socket.hpp"
+
+namespace rt {
+
+// Bytes relayed by copy_bidirectional() in each direction
+struct Relayed {
+  std::uint64_t a_to_b{0};
+  std::uint64_t b_to_a{0};
+};
+
+// Moves up to max bytes from one socket to the other, stops early when from
+// is shut down. Returns number of bytes moved.
+Result<std::size_t> splice(Socket& from, Socket& to, std::size_t max) noexcept;
+
+// Relays data both ways until both sides shut down, the shutdown of each
+// side is forwarded to the other. Runs as a single task, receives from both
+// sides are kept pending at once, so the task parks only when neither
+// direction can make progress.
+// NOTE: stackful tasks only
+Result<Relayed> copy_bidirectional(Socket& a, Socket& b) noexcept;
+
+}  // namespace rt
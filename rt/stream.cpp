@@ -0,0 +1,47 @@
+#include "stream.hpp"
+
+
+namespace rt {
+
+Result<std::size_t> StreamRef::recv(char* data, std::size_t n) noexcept {
+  if (m_socket) {
+    return m_socket->recv(data, n);
+  }
+
+  return m_loopback->recv(data, n);
+}
+
+Result<std::size_t> StreamRef::recv_vectored(const IoSliceMut* slices,
+                                             std::size_t n) noexcept {
+  if (m_socket) {
+    return m_socket->recv_vectored(slices, n);
+  }
+
+  return m_loopback->recv_vectored(slices, n);
+}
+
+std::error_code StreamRef::send_all(const char* data, std::size_t n) noexcept {
+  if (m_socket) {
+    return m_socket->send_all(data, n);
+  }
+
+  return m_loopback->send_all(data, n);
+}
+
+std::error_code StreamRef::send_all_vectored(IoSlice* slices, std::size_t n) noexcept {
+  if (m_socket) {
+    return m_socket->send_all_vectored(slices, n);
+  }
+
+  return m_loopback->send_all_vectored(slices, n);
+}
+
+std::error_code StreamRef::shutdown() noexcept {
+  if (m_socket) {
+    return m_socket->shutdown();
+  }
+
+  return m_loopback->shutdown();
+}
+
+} // namespace rt
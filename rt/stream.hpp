@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <system_error>
+
+#include "loopback.hpp"
+#include "result.hpp"
+#include "socket.hpp"
+
+
+namespace rt {
+
+// Non-owning reference to a connected byte stream, either a Socket or a
+// LoopbackStream. Lets the framing layer (BufReader, BufWriter) and
+// connection handlers run over both, e.g. to benchmark them without the
+// kernel.
+class StreamRef {
+ public:
+  StreamRef(Socket& s) noexcept : m_socket(&s) {}
+  StreamRef(LoopbackStream& s) noexcept : m_loopback(&s) {}
+
+  Result<std::size_t> recv(char* data, std::size_t n) noexcept;
+  Result<std::size_t> recv_vectored(const IoSliceMut* slices, std::size_t n) noexcept;
+  std::error_code send_all(const char* data, std::size_t n) noexcept;
+  // NOTE: slices are modified to track progress
+  std::error_code send_all_vectored(IoSlice* slices, std::size_t n) noexcept;
+  std::error_code shutdown() noexcept;
+
+ private:
+  // exactly one is set
+  Socket* m_socket{nullptr};
+  LoopbackStream* m_loopback{nullptr};
+};
+
+} // namespace rt
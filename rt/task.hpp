@@ -1,18 +1,24 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cassert>
+#include <coroutine>
 #include <memory>
+#include <source_location>
 #include <type_traits>
 #include <utility>
 #include <system_error>
 
+#include "arena.hpp"
 #include "cpu_context.hpp"
 #include "handle.hpp"
 
 
 namespace rt {
+class IoEngine;
 class Worker;
+struct IoOp;
 
 namespace detail {
 
@@ -30,15 +36,41 @@ struct TaskFnImpl : BaseTaskFn, F {
 
 }  // namespace detail
 
+// Scheduling class of a task, ready tasks of each class are kept in their own
+// queue
+enum class Priority : std::uint8_t {
+  Critical,    // latency-sensitive, e.g. connection handlers
+  Normal,
+  Background,  // batch jobs, runs when nothing else is ready (mostly)
+};
+
+constexpr std::size_t N_PRIORITIES = 3;
+
 struct Task {
   static constexpr std::uint64_t STACK_SIZE = 1024 * 32;
+  // operations a task can complete without parking before it's forced to
+  // yield, refilled every time the task is switched in
+  static constexpr std::uint32_t BUDGET = 128;
 
   CpuContext context{};
   std::size_t fn_size{0};
   char* stack{nullptr};
 
   Worker* owner{nullptr};
+  Worker* last_worker{nullptr};  // worker which ran the task last time
   Task* next{nullptr};
+  std::uint64_t ready_at{0};  // monotonic_ns() when task was made ready
+  Priority priority{Priority::Normal};
+  std::uint32_t budget{BUDGET};
+  std::source_location spawned_at{};
+  // set for stackless tasks (which have no stack), innermost suspended
+  // coroutine which the worker resumes
+  std::coroutine_handle<> coroutine{};
+  Arena arena{};              // reset when task completes
+  // see Waker, generation << 2 | state, written by other threads
+  std::atomic<std::uint64_t> wake_state{0};
+  IoOp* wake_op{nullptr};          // valid while parked in wait_for_wake()
+  IoEngine* wake_engine{nullptr};
 
   ~Task() { reset(); }
 
@@ -77,5 +109,15 @@ struct Task {
   void finalize();
   void yield();
   void block_on_io();
+  // parks until Worker::wake() is called for this task
+  void park();
+  void consume_budget();
+
+  // used by stackless tasks, which return to the worker by suspending
+  // instead of switching context
+  void suspend_yield() noexcept;
+  void suspend_on_io() noexcept;
+  void suspend_park() noexcept;
+  void finalize_coroutine() noexcept;
 };
 }  // namespace rt
\ No newline at end of file
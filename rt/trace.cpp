@@ -0,0 +1,160 @@
+#include "trace.hpp"
+
+#include <algorithm>
+
+
+namespace rt {
+
+namespace detail {
+std::atomic<bool> TRACING{false};
+}  // namespace detail
+
+void set_tracing(bool enabled) noexcept {
+  detail::TRACING.store(enabled, std::memory_order_relaxed);
+}
+
+static constexpr std::uint64_t ARG_MASK = (std::uint64_t{1} << 56) - 1;
+
+void TraceBuffer::write(TraceEventKind kind, const void* task,
+                        std::uint64_t arg) noexcept {
+  auto* slots = m_slots.load(std::memory_order_relaxed);
+  if (!slots) {
+    slots = new Slot[CAPACITY];
+    m_slots.store(slots, std::memory_order_release);
+  }
+
+  const auto pos = m_head.load(std::memory_order_relaxed);
+  auto& slot = slots[pos & (CAPACITY - 1)];
+  slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.ts.store(monotonic_ns(), std::memory_order_relaxed);
+  slot.task.store(reinterpret_cast<std::uint64_t>(task), std::memory_order_relaxed);
+  slot.arg_kind.store(std::uint64_t{static_cast<std::uint8_t>(kind)} << 56 | (arg & ARG_MASK),
+                      std::memory_order_relaxed);
+  slot.seq.store(2 * (pos + 1), std::memory_order_release);
+  m_head.store(pos + 1, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceBuffer::snapshot() const {
+  std::vector<TraceEvent> events;
+  const auto* slots = m_slots.load(std::memory_order_acquire);
+  if (!slots) {
+    return events;
+  }
+
+  const auto head = m_head.load(std::memory_order_acquire);
+  const auto first = head > CAPACITY ? head - CAPACITY : 0;
+  events.reserve(static_cast<std::size_t>(head - first));
+  for (auto pos = first; pos < head; ++pos) {
+    const auto& slot = slots[pos & (CAPACITY - 1)];
+    const auto seq = slot.seq.load(std::memory_order_acquire);
+    TraceEvent e;
+    e.ts = slot.ts.load(std::memory_order_relaxed);
+    e.task = reinterpret_cast<const void*>(slot.task.load(std::memory_order_relaxed));
+    const auto arg_kind = slot.arg_kind.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq != 2 * (pos + 1) || slot.seq.load(std::memory_order_relaxed) != seq) {
+      // overwritten by the worker while we were reading it
+      continue;
+    }
+
+    e.arg = arg_kind & ARG_MASK;
+    e.kind = static_cast<TraceEventKind>(arg_kind >> 56);
+    events.emplace_back(e);
+  }
+
+  return events;
+}
+
+static const char* event_name(TraceEventKind kind) {
+  switch (kind) {
+    case TraceEventKind::Spawn:
+      return "spawn";
+    case TraceEventKind::SwitchIn:
+      return "switch-in";
+    case TraceEventKind::Yield:
+      return "yield";
+    case TraceEventKind::BlockOnIo:
+      return "block-on-io";
+    case TraceEventKind::Wake:
+      return "wake";
+    case TraceEventKind::Steal:
+      return "steal";
+    case TraceEventKind::Finalize:
+      return "finalize";
+    case TraceEventKind::Park:
+      return "park";
+  }
+
+  return "unknown";
+}
+
+static bool ends_slice(TraceEventKind kind) {
+  return kind == TraceEventKind::Yield || kind == TraceEventKind::BlockOnIo ||
+         kind == TraceEventKind::Finalize || kind == TraceEventKind::Park;
+}
+
+void write_chrome_trace(std::ostream& out,
+                        const std::vector<std::vector<TraceEvent>>& workers) {
+  std::uint64_t start = ~std::uint64_t{0};
+  for (const auto& events : workers) {
+    if (!events.empty()) {
+      start = (std::min)(start, events.front().ts);
+    }
+  }
+
+  // timestamps are in microseconds
+  const auto write_ts = [&](std::uint64_t ts) {
+    const auto ns = ts - start;
+    out << ns / 1000 << '.' << (ns % 1000) / 100 << (ns % 100) / 10 << ns % 10;
+  };
+
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  const auto begin_event = [&](std::size_t tid, std::uint64_t ts, const char* ph) {
+    out << (first ? "" : ",\n") << "{\"pid\":0,\"tid\":" << tid << ",\"ph\":\"" << ph
+        << "\",\"ts\":";
+    write_ts(ts);
+    first = false;
+  };
+
+  for (std::size_t tid = 0; tid < workers.size(); ++tid) {
+    begin_event(tid, start, "M");
+    out << ",\"name\":\"thread_name\",\"args\":{\"name\":\"worker " << tid << "\"}}";
+
+    const void* running = nullptr;
+    std::uint64_t last_ts = start;
+    for (const auto& e : workers[tid]) {
+      last_ts = e.ts;
+      if (e.kind == TraceEventKind::SwitchIn) {
+        if (running) {
+          begin_event(tid, e.ts, "E");
+          out << "}";
+        }
+        running = e.task;
+        begin_event(tid, e.ts, "B");
+        out << ",\"name\":\"task " << e.task << "\"}";
+        continue;
+      }
+
+      begin_event(tid, e.ts, "i");
+      out << ",\"s\":\"t\",\"name\":\"" << event_name(e.kind)
+          << "\",\"args\":{\"task\":\"" << e.task << "\",\"arg\":" << e.arg << "}}";
+
+      if (ends_slice(e.kind) && running == e.task) {
+        begin_event(tid, e.ts, "E");
+        out << "}";
+        running = nullptr;
+      }
+    }
+
+    if (running) {
+      begin_event(tid, last_ts, "E");
+      out << "}";
+    }
+  }
+
+  out << "\n]}\n";
+}
+
+} // namespace rt
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "metrics.hpp"
+
+
+namespace rt {
+
+enum class TraceEventKind : std::uint8_t {
+  Spawn,
+  SwitchIn,
+  Yield,
+  BlockOnIo,
+  Wake,
+  Steal,
+  Finalize,
+  Park,
+};
+
+struct TraceEvent {
+  std::uint64_t ts{0};  // monotonic_ns()
+  const void* task{nullptr};
+  std::uint64_t arg{0};  // kind specific, e.g. victim index for Steal
+  TraceEventKind kind{TraceEventKind::Spawn};
+};
+
+// Tracing is off by default, it can be toggled at any moment from any thread
+void set_tracing(bool enabled) noexcept;
+
+namespace detail {
+extern std::atomic<bool> TRACING;
+}  // namespace detail
+
+inline bool tracing_enabled() noexcept {
+  return detail::TRACING.load(std::memory_order_relaxed);
+}
+
+// Ring buffer of recent events of a single worker. Only the owning worker
+// records events, snapshot() can be called from any thread. When the buffer
+// is full the oldest events are overwritten.
+class TraceBuffer {
+ public:
+  static constexpr std::size_t CAPACITY = 1 << 16;
+
+  TraceBuffer() noexcept = default;
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer(TraceBuffer&& other) noexcept
+      : m_slots{other.m_slots.exchange(nullptr)},
+        m_head{other.m_head.load()} {}
+  TraceBuffer& operator=(const TraceBuffer&) = delete;
+  TraceBuffer& operator=(TraceBuffer&&) = delete;
+  ~TraceBuffer() noexcept { delete[] m_slots.load(); }
+
+  void record(TraceEventKind kind, const void* task, std::uint64_t arg = 0) noexcept {
+    if (!tracing_enabled()) {
+      return;
+    }
+
+    write(kind, task, arg);
+  }
+
+  // returns events ordered from the oldest to the newest
+  std::vector<TraceEvent> snapshot() const;
+
+ private:
+  // each slot is a seqlock, so readers can detect torn events
+  struct Slot {
+    std::atomic<std::uint64_t> seq{0};  // 2 * (position + 1) when complete
+    std::atomic<std::uint64_t> ts{0};
+    std::atomic<std::uint64_t> task{0};
+    std::atomic<std::uint64_t> arg_kind{0};  // kind in the top byte
+  };
+
+  void write(TraceEventKind kind, const void* task, std::uint64_t arg) noexcept;
+
+  std::atomic<Slot*> m_slots{nullptr};  // allocated on first use
+  std::atomic<std::uint64_t> m_head{0};
+};
+
+// Writes events of all workers in Chrome trace event format (JSON), the
+// result can be opened in chrome://tracing or https://ui.perfetto.dev
+void write_chrome_trace(std::ostream& out,
+                        const std::vector<std::vector<TraceEvent>>& workers);
+
+} // namespace rt
@@ -0,0 +1,68 @@
+#include "waker.hpp"
+
+#include "io_engine.hpp"
+#include "worker.hpp"
+
+namespace rt {
+
+// states in the low bits of Task::wake_state
+static constexpr std::uint64_t WAKE_IDLE = 0;
+static constexpr std::uint64_t WAKE_ARMED = 1;     // waker given out
+static constexpr std::uint64_t WAKE_PARKED = 2;    // in wait_for_wake()
+static constexpr std::uint64_t WAKE_NOTIFIED = 3;  // waker invoked
+static constexpr std::uint64_t WAKE_MASK = 3;
+
+Waker Waker::current() noexcept {
+  auto* task = current_task();
+  const auto state = task->wake_state.load(std::memory_order_relaxed);
+  // NOTE: bumping the generation invalidates copies of earlier wakers
+  const auto generation = (state >> 2) + 1;
+  task->wake_state.store(generation << 2 | WAKE_ARMED, std::memory_order_release);
+  return {task, generation};
+}
+
+void Waker::wake() const noexcept {
+  assert(m_task);
+  auto state = m_task->wake_state.load(std::memory_order_acquire);
+  while (true) {
+    const auto kind = state & WAKE_MASK;
+    if ((state >> 2) != m_generation || kind == WAKE_NOTIFIED || kind == WAKE_IDLE) {
+      // stale or already woken
+      return;
+    }
+
+    if (m_task->wake_state.compare_exchange_weak(
+            state, m_generation << 2 | WAKE_NOTIFIED, std::memory_order_acq_rel,
+            std::memory_order_acquire)) {
+      break;
+    }
+  }
+
+  if ((state & WAKE_MASK) == WAKE_PARKED) {
+    // NOTE: the task can't resume before this completion is dequeued, so its
+    //       op is still alive
+    m_task->wake_engine->notify(m_task->wake_op);
+  }
+}
+
+void wait_for_wake() {
+  auto* task = current_task();
+  IoOp op{task};
+  task->wake_op = &op;
+  task->wake_engine = task->owner->io();
+
+  auto state = task->wake_state.load(std::memory_order_acquire);
+  assert((state & WAKE_MASK) == WAKE_ARMED || (state & WAKE_MASK) == WAKE_NOTIFIED);
+  if ((state & WAKE_MASK) == WAKE_ARMED &&
+      task->wake_state.compare_exchange_strong(
+          state, (state & ~WAKE_MASK) | WAKE_PARKED, std::memory_order_acq_rel,
+          std::memory_order_acquire)) {
+    task->block_on_io();
+  }
+
+  task->wake_state.store((state & ~WAKE_MASK) | WAKE_IDLE, std::memory_order_relaxed);
+  task->wake_op = nullptr;
+  task->wake_engine = nullptr;
+}
+
+}  // namespace rt
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+#include "task.hpp"
+
+namespace rt {
+
+// Wakes a task parked in wait_for_wake() from any thread, e.g. from the
+// callback of a library with its own threads:
+//
+//   auto waker = rt::Waker::current();
+//   client.get_async(key, [waker] { waker.wake(); });
+//   rt::wait_for_wake();
+//
+// The task is made ready on the worker it parked on through a posted
+// completion, which also wakes the worker if it's sleeping. Copies can be
+// freely passed around, only the first wake() has an effect and wake()
+// after the task was woken is ignored even if it parks again.
+// NOTE: stackful tasks only
+class Waker {
+ public:
+  Waker() noexcept = default;
+
+  // arms the current task, it should call wait_for_wake() next
+  static Waker current() noexcept;
+
+  bool valid() const noexcept { return m_task != nullptr; }
+  // safe to call from any thread, doesn't block
+  // NOTE: takes a lock, so it's not safe to call from a signal handler
+  void wake() const noexcept;
+
+ private:
+  Waker(Task* task, std::uint64_t generation) noexcept
+      : m_task(task), m_generation(generation) {}
+
+  Task* m_task{nullptr};
+  std::uint64_t m_generation{0};
+};
+
+// parks the current task until the waker returned by the last
+// Waker::current() is invoked, returns immediately if it already was
+void wait_for_wake();
+
+}  // namespace rt
@@ -0,0 +1,131 @@
+#include "watchdog.hpp"
+#include "worker.hpp"
+
+#include <iostream>
+
+
+namespace rt {
+
+void Heartbeat::store(const Snapshot& s) noexcept {
+  m_beats.store(s.beats - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_since_ns.store(s.since_ns, std::memory_order_relaxed);
+  m_task.store(s.task, std::memory_order_relaxed);
+  m_file.store(s.file, std::memory_order_relaxed);
+  m_function.store(s.function, std::memory_order_relaxed);
+  m_line.store(s.line, std::memory_order_relaxed);
+  m_beats.store(s.beats, std::memory_order_release);
+}
+
+Heartbeat::Snapshot Heartbeat::read() const noexcept {
+  Snapshot s;
+  while (true) {
+    s.beats = m_beats.load(std::memory_order_acquire);
+    if (s.beats & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    s.since_ns = m_since_ns.load(std::memory_order_relaxed);
+    s.task = m_task.load(std::memory_order_relaxed);
+    s.file = m_file.load(std::memory_order_relaxed);
+    s.function = m_function.load(std::memory_order_relaxed);
+    s.line = m_line.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_beats.load(std::memory_order_relaxed) == s.beats) {
+      return s;
+    }
+  }
+}
+
+static void print_stall(const StallReport& report) {
+  std::cerr << "rt: worker " << report.worker << " is stuck on task "
+            << report.task << " for " << report.stalled_for.count() << "ms"
+            << ", spawned at " << (report.file ? report.file : "?") << ":"
+            << report.line << " in " << (report.function ? report.function : "?");
+  if (report.migrated != 0) {
+    std::cerr << ", migrated " << report.migrated << " queued tasks";
+  }
+  std::cerr << std::endl;
+}
+
+Watchdog::Watchdog(WatchdogConfig config, std::vector<Worker*> workers)
+    : m_config(std::move(config)),
+      m_workers(std::move(workers)),
+      m_thread([this] { run(); }) {}
+
+Watchdog::~Watchdog() noexcept {
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_one();
+  m_thread.join();
+}
+
+std::size_t Watchdog::migrate(std::size_t from,
+                              const std::vector<bool>& stalled) noexcept {
+  std::vector<Worker*> healthy;
+  for (std::size_t i = 0; i < m_workers.size(); ++i) {
+    if (!stalled[i]) {
+      healthy.push_back(m_workers[i]);
+    }
+  }
+
+  if (healthy.empty()) {
+    return 0;
+  }
+
+  std::size_t migrated = 0;
+  while (auto* task = m_workers[from]->steal()) {
+    healthy[migrated % healthy.size()]->inject(task);
+    ++migrated;
+  }
+  return migrated;
+}
+
+void Watchdog::run() {
+  const auto threshold_ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(m_config.threshold).count());
+  // beats value for which the stall was already reported
+  std::vector<std::uint64_t> reported(m_workers.size(), 0);
+  std::vector<Heartbeat::Snapshot> beats(m_workers.size());
+  std::vector<bool> stalled(m_workers.size(), false);
+
+  std::unique_lock lock(m_mutex);
+  while (!m_cv.wait_for(lock, m_config.interval, [this] { return m_stop; })) {
+    const auto now = monotonic_ns();
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+      beats[i] = m_workers[i]->heartbeat().read();
+      stalled[i] = beats[i].task && now > beats[i].since_ns &&
+                   now - beats[i].since_ns >= threshold_ns;
+    }
+
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+      if (!stalled[i] || reported[i] == beats[i].beats) {
+        continue;
+      }
+
+      reported[i] = beats[i].beats;
+      StallReport report;
+      report.worker = i;
+      report.task = beats[i].task;
+      report.file = beats[i].file;
+      report.function = beats[i].function;
+      report.line = beats[i].line;
+      report.stalled_for = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::nanoseconds{now - beats[i].since_ns});
+      if (m_config.migrate) {
+        report.migrated = migrate(i, stalled);
+      }
+
+      if (m_config.on_stall) {
+        m_config.on_stall(report);
+      } else {
+        print_stall(report);
+      }
+    }
+  }
+}
+
+} // namespace rt
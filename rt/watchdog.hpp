@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "task.hpp"
+
+
+namespace rt {
+
+class Worker;
+
+// Published by a worker every time it switches to a task or goes idle, read
+// by the watchdog thread.
+// NOTE: single writer, readers retry if they see a torn update
+class Heartbeat {
+ public:
+  struct Snapshot {
+    std::uint64_t beats{0};
+    std::uint64_t since_ns{0};  // monotonic_ns() of the last beat
+    const Task* task{nullptr};  // nullptr when worker is idle
+    const char* file{nullptr};  // spawn site of task
+    const char* function{nullptr};
+    std::uint32_t line{0};
+  };
+
+  Heartbeat() noexcept = default;
+  Heartbeat(const Heartbeat& other) noexcept { store(other.read()); }
+  Heartbeat& operator=(const Heartbeat&) = delete;
+
+  void beat(const Task* task, std::uint64_t now) noexcept {
+    Snapshot s;
+    s.beats = m_beats.load(std::memory_order_relaxed) + 2;
+    s.since_ns = now;
+    s.task = task;
+    if (task) {
+      s.file = task->spawned_at.file_name();
+      s.function = task->spawned_at.function_name();
+      s.line = task->spawned_at.line();
+    }
+    store(s);
+  }
+
+  Snapshot read() const noexcept;
+
+ private:
+  void store(const Snapshot& s) noexcept;
+
+  std::atomic<std::uint64_t> m_beats{0};  // odd while being updated
+  std::atomic<std::uint64_t> m_since_ns{0};
+  std::atomic<const Task*> m_task{nullptr};
+  std::atomic<const char*> m_file{nullptr};
+  std::atomic<const char*> m_function{nullptr};
+  std::atomic<std::uint32_t> m_line{0};
+};
+
+struct StallReport {
+  std::size_t worker{0};
+  const Task* task{nullptr};
+  const char* file{nullptr};  // where the task was spawned
+  const char* function{nullptr};
+  std::uint32_t line{0};
+  std::chrono::milliseconds stalled_for{0};
+  std::size_t migrated{0};    // queued tasks moved to other workers
+};
+
+struct WatchdogConfig {
+  std::chrono::milliseconds interval{100};
+  // report a worker running the same task for longer than this
+  std::chrono::milliseconds threshold{1000};
+  // steal queued tasks of a stalled worker and hand them to healthy ones
+  // NOTE: ready and yielded tasks are moved, woken ones (m_woken) can't be
+  //       stolen and stay on the stalled worker
+  bool migrate{false};
+  // called on the watchdog thread once per stall, prints to stderr if empty
+  std::function<void(const StallReport&)> on_stall{};
+};
+
+// Thread which periodically checks heartbeats of all workers
+class Watchdog {
+ public:
+  Watchdog(WatchdogConfig config, std::vector<Worker*> workers);
+  Watchdog(const Watchdog&) = delete;
+  Watchdog& operator=(const Watchdog&) = delete;
+  ~Watchdog() noexcept;
+
+ private:
+  void run();
+  std::size_t migrate(std::size_t from, const std::vector<bool>& stalled) noexcept;
+
+  WatchdogConfig m_config;
+  std::vector<Worker*> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop{false};
+  std::thread m_thread;  // NOTE: started last
+};
+
+} // namespace rt
@@ -1,4 +1,5 @@
 #include "worker.hpp"
+#include "shard.hpp"
 
 
 extern "C" {
@@ -12,7 +13,7 @@ thread_local Task* CURRENT_TASK{nullptr};
 Task* current_task() { return CURRENT_TASK; }
 
 void Task::finalize() {
-  TRACE_TASK(this, "finalize");
+  owner->m_trace.record(TraceEventKind::Finalize, this);
   auto* main = &owner->m_main;
   owner->release_task(this);
   // NOTE: this code relies on fact that release_task() doesn't
@@ -23,31 +24,78 @@ void Task::finalize() {
 }
 
 void Task::yield() {
-  owner->m_ready.push(this);
+  assert(!coroutine && "stackless tasks should co_await rt::co::yield()");
+  suspend_yield();
   rt_cpu_context_swap(&context, &owner->m_main);
   // owner->run(&context);
 }
 
 void Task::block_on_io() {
-  TRACE_TASK(this, "blocked");
+  assert(!coroutine && "stackless tasks should use rt::co awaitables");
   // NOTE: task ptr should be already saved in m_io
-  ++owner->m_io_blocked;
+  suspend_on_io();
   rt_cpu_context_swap(&context, &owner->m_main);
   // owner->run(&context);
 }
 
+void Task::park() {
+  assert(!coroutine && "stackless tasks should co_await");
+  suspend_park();
+  rt_cpu_context_swap(&context, &owner->m_main);
+}
+
+void Task::suspend_park() noexcept {
+  owner->m_trace.record(TraceEventKind::Park, this);
+}
+
+void Task::suspend_yield() noexcept {
+  owner->m_trace.record(TraceEventKind::Yield, this);
+  // NOTE: pushing it to m_ready would make it the next task to run, since
+  //       the owner pops LIFO. It's queued by run_task() once switched out,
+  //       since other workers can take it from there.
+  ready_at = monotonic_ns();
+  owner->m_yielding = this;
+}
+
+void Task::suspend_on_io() noexcept {
+  owner->m_trace.record(TraceEventKind::BlockOnIo, this);
+  ++owner->m_io_blocked;
+}
+
+void Task::finalize_coroutine() noexcept {
+  owner->m_trace.record(TraceEventKind::Finalize, this);
+  owner->release_task(this);
+}
+
+void Task::consume_budget() {
+  // NOTE: stackless tasks can't be suspended from a plain function call
+  if (coroutine) {
+    return;
+  }
+
+  if (--budget == 0) {
+    owner->m_metrics.forced_yields.add();
+    yield();
+  }
+}
+
 void yield() {
   auto* task = CURRENT_TASK;
   task->yield();
 }
 
+void consume_budget() {
+  auto* task = CURRENT_TASK;
+  task->consume_budget();
+}
+
 void task_main(Task* task) {
-  TRACE_TASK(task, "main");
   task->call();
   task->finalize();
 }
 
-Worker::Worker(IoEngine io) noexcept : m_io(std::move(io)) {}
+Worker::Worker(IoEngine io, BlockingPool* blocking) noexcept
+    : m_io(std::move(io)), m_blocking(blocking) {}
 
 Worker::~Worker() noexcept {
   const auto free_task = [](Task* task) {
@@ -58,31 +106,154 @@ Worker::~Worker() noexcept {
     delete task;
   };
 
-  while (auto* task = m_ready.pop()) {
+  for (auto& queue : m_ready) {
+    while (auto* task = queue.pop()) {
+      free_task(task);
+    }
+  }
+
+  for (auto& yielded : m_yielded) {
+    while (auto* task = yielded.pop()) {
+      free_task(task);
+    }
+  }
+
+  for (auto& woken : m_woken) {
+    while (auto* task = woken.pop_front()) {
+      free_task(task);
+    }
+  }
+
+  auto injected = m_inbox.take();
+  while (auto* task = injected.pop_front()) {
     free_task(task);
   }
 
   while (auto* task = m_freelist.pop_front()) {
     free_task(task);
   }
+
+  while (auto* task = m_stackless_freelist.pop_front()) {
+    free_task(task);
+  }
+}
+
+Task* Worker::create_coroutine_task(std::coroutine_handle<> h, Priority priority,
+                                    std::source_location location) noexcept {
+  auto* task = allocate_stackless_task();
+  task->coroutine = h;
+  task->priority = priority;
+  task->spawned_at = location;
+  task->owner = this;
+  m_trace.record(TraceEventKind::Spawn, task);
+  m_metrics.spawns.add();
+  return task;
+}
+
+void Worker::schedule(Task* task, Placement placement) noexcept {
+  if (placement.kind == Placement::Kind::Default) {
+    placement = m_default_placement;
+  }
+
+  if (placement.kind == Placement::Kind::Local || m_all.empty()) {
+    make_ready(task);
+    return;
+  }
+
+  const auto idx = detail::pick_worker(placement, m_all.data(), m_all.size(), m_id,
+                                       m_rng, m_round_robin);
+  auto* target = m_all[idx];
+  if (target == this) {
+    make_ready(task);
+  } else {
+    target->inject(task);
+  }
+}
+
+std::size_t Worker::load() const noexcept {
+  std::size_t n = m_n_woken.get() + m_inbox.size();
+  for (std::size_t i = 0; i < N_PRIORITIES; ++i) {
+    n += m_ready[i].size() + m_yielded[i].size();
+  }
+  return n;
+}
+
+void Worker::run_blocking(detail::BlockingJob* job) noexcept {
+  auto* task = CURRENT_TASK;
+  assert(job->op.task == task);
+  job->engine = &m_io;
+  m_blocking->submit(job);
+  task->block_on_io();
+}
+
+WorkerMetricsSnapshot Worker::metrics() const noexcept {
+  auto s = m_metrics.snapshot();
+  for (const auto& queue : m_ready) {
+    s.queue_depth += queue.size();
+    s.queue_grows += queue.grows();
+  }
+  return s;
+}
+
+bool Worker::take_back(Task* task) noexcept {
+  auto& queue = m_ready[static_cast<std::size_t>(task->priority)];
+  auto* top = queue.pop();
+  if (top == task) {
+    release_task(task);
+    return true;
+  }
+
+  if (top) {
+    queue.push(top);
+  }
+  return false;
 }
 
 Task* Worker::try_steal() noexcept {
-  if (m_n_workers == 0) {
+  if (m_n_workers == 0 || m_shard) {
     return nullptr;
   }
 
+  m_metrics.steal_attempts.add();
   std::size_t mid = m_rng.gen() % m_n_workers;
-  for (std::size_t i = mid; i < m_n_workers; ++i) {
+  for (std::size_t k = 0; k < m_n_workers; ++k) {
+    const auto i = (mid + k) % m_n_workers;
     if (auto* task = m_workers[i]->steal()) {
+      m_metrics.steals.add();
+      // NOTE: m_workers skips this worker, trace the index in the runtime
+      m_trace.record(TraceEventKind::Steal, task, i < m_id ? i : i + 1);
       task->owner = this;
       return task;
     }
   }
 
-  for (std::size_t i = 0; i < mid; ++i) {
-    if (auto* task = m_workers[i]->steal()) {
-      task->owner = this;
+  return nullptr;
+}
+
+Task* Worker::pop_ready() noexcept {
+  // Weighted round robin over priority classes: out of every 21 picks 16 go
+  // to critical, 4 to normal and 1 to background tasks while all of them
+  // are ready, so lower classes are delayed but never starved. If the class
+  // of the slot has nothing ready, the most urgent ready task is taken.
+  constexpr std::uint32_t critical_weight = 16;
+  constexpr std::uint32_t normal_weight = 4;
+  constexpr std::uint32_t background_weight = 1;
+  constexpr std::uint32_t total = critical_weight + normal_weight + background_weight;
+
+  const auto slot = m_tick++ % total;
+  const std::size_t first = slot < critical_weight                 ? 0
+                            : slot < critical_weight + normal_weight ? 1
+                                                                     : 2;
+  if (auto* task = pop_class(first)) {
+    return task;
+  }
+
+  for (std::size_t i = 0; i < N_PRIORITIES; ++i) {
+    if (i == first) {
+      continue;
+    }
+
+    if (auto* task = pop_class(i)) {
       return task;
     }
   }
@@ -90,15 +261,82 @@ Task* Worker::try_steal() noexcept {
   return nullptr;
 }
 
+Task* Worker::pop_class(std::size_t priority) noexcept {
+  if (auto* task = m_woken[priority].pop_front()) {
+    m_n_woken.set(m_n_woken.get() - 1);
+    return task;
+  }
+
+  if (auto* task = m_ready[priority].pop()) {
+    return task;
+  }
+
+  return m_yielded[priority].pop();
+}
+
+void Worker::make_woken(Task* task) noexcept {
+  // Woken tasks stay on this worker (the one they blocked on), so their
+  // stack stays in cache and their handles stay registered with m_io.
+  // Only when the backlog is long they are made stealable.
+  constexpr std::size_t overload_threshold = 64;
+  // NOTE: load() includes woken tasks
+  if (load() >= overload_threshold) {
+    make_ready(task);
+    return;
+  }
+
+  task->ready_at = monotonic_ns();
+  m_woken[static_cast<std::size_t>(task->priority)].push_back(task);
+  m_n_woken.add();
+}
+
+std::size_t Worker::poll_shard() noexcept {
+  std::size_t n = 0;
+  for (auto* queue : m_shard->in) {
+    if (!queue) {
+      continue;
+    }
+
+    while (auto* msg = queue->pop()) {
+      msg->run(*this);
+      ++n;
+    }
+  }
+  return n;
+}
+
 Task* Worker::next_task() noexcept {
-  auto* task = m_ready.pop();
+  if (m_shard) {
+    poll_shard();
+  }
+
+  auto injected = m_inbox.take();
+  while (auto* task = injected.pop_front()) {
+    task->owner = this;
+    make_ready(task);
+  }
+
+  // If local queues never run dry, wait_io() is never called by run(), poll
+  // IO periodically so that completions and yielded tasks aren't starved
+  // by tasks which keep becoming ready in their class
+  constexpr std::uint32_t poll_interval = 61;
+  if (++m_since_poll >= poll_interval) {
+    wait_io(0);
+    for (auto& yielded : m_yielded) {
+      if (auto* task = yielded.pop()) {
+        return task;
+      }
+    }
+  }
+
+  auto* task = pop_ready();
   if (!task) {
     task = try_steal();
   }
   return task;
 }
 
-bool Worker::wait_io() noexcept {
+bool Worker::wait_io(std::size_t wait_ms) noexcept {
   // NOTE: this doesn't work on windows, since underlying
   //       IOCP queue is shared among all workers
   // if (m_io_blocked == 0) {
@@ -106,18 +344,24 @@ bool Worker::wait_io() noexcept {
   // }
 
   constexpr std::size_t n_events = 64;
-  // FIXME: it is set to 20 as temporary hack to wake up threads periodically,
-  //        use -1 when we'll have a normal thread notification algorithm
-  constexpr std::size_t wait_ms = static_cast<std::size_t>(20);
+  m_since_poll = 0;
 
   rt::CompletionEvent events[n_events];
+  const auto wait_start = monotonic_ns();
   std::size_t n = m_io.wait(events, n_events, wait_ms);
+  m_metrics.idle_ns.add(monotonic_ns() - wait_start);
+  m_metrics.io_waits.add();
+  m_metrics.io_completions.add(n);
+  m_metrics.io_batch.record(n);
   // assert(n != 0);
   for (std::size_t i = 0; i < n; ++i) {
     --m_io_blocked;
     auto* task = reinterpret_cast<Task*>(events[i].context);
+    // NOTE: completions are posted to the engine of the worker which issued
+    //       the operation, so this is the worker the task blocked on
     task->owner = this;
-    m_ready.push(task);
+    m_trace.record(TraceEventKind::Wake, task);
+    make_woken(task);
   }
 
   return true;
@@ -132,9 +376,25 @@ void Worker::run(Worker** workers, std::size_t n) noexcept {
 }
 
 void Worker::run(CpuContext* current) noexcept {
+  // FIXME: it is set to 20 as temporary hack to wake up threads periodically,
+  //        use -1 when we'll have a normal thread notification algorithm
+  constexpr std::size_t wait_ms = static_cast<std::size_t>(20);
+
   Task* task = next_task();
   while (!task) {
-    wait_io();
+    m_heartbeat.beat(nullptr, monotonic_ns());
+    if (m_shard) {
+      // NOTE: pairs with the fence in send_to_shard(), either the sender
+      //       sees sleeping set or we see its message here
+      m_shard->sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (poll_shard() == 0) {
+        wait_io(wait_ms);
+      }
+      m_shard->sleeping.store(false, std::memory_order_relaxed);
+    } else {
+      wait_io(wait_ms);
+    }
     task = next_task();
   }
 
@@ -143,13 +403,42 @@ void Worker::run(CpuContext* current) noexcept {
 
 void Worker::release_task(Task* task) noexcept {
   task->reset();
-  m_freelist.push_front(task);
+  // NOTE: after reset(), captured state might have used the arena too
+  task->arena.reset(m_chunks);
+  task->last_worker = nullptr;
+  if (task->coroutine) {
+    task->coroutine = {};
+    m_stackless_freelist.push_front(task);
+  } else {
+    m_freelist.push_front(task);
+  }
+  m_metrics.tasks_free.add();
 }
 
 void Worker::run_task(Task* task, CpuContext* current) noexcept {
   CURRENT_TASK = task;
-  TRACE_TASK(task, "switching in");
-  rt_cpu_context_swap(current, &task->context);
+  task->budget = Task::BUDGET;
+  m_trace.record(TraceEventKind::SwitchIn, task);
+  m_metrics.polls.add();
+  if (task->last_worker != this) {
+    if (task->last_worker) {
+      m_metrics.migrations.add();
+    }
+    task->last_worker = this;
+  }
+  const auto now = monotonic_ns();
+  m_metrics.schedule_delay_ns.record(now - task->ready_at);
+  m_heartbeat.beat(task, now);
+  if (task->coroutine) {
+    // stackless task runs on the worker's stack until it suspends
+    task->coroutine.resume();
+  } else {
+    rt_cpu_context_swap(current, &task->context);
+  }
+
+  if (auto* yielded = std::exchange(m_yielding, nullptr)) {
+    m_yielded[static_cast<std::size_t>(yielded->priority)].push(yielded);
+  }
 }
 
 void Worker::init_task(Task* task) noexcept {
@@ -171,9 +460,24 @@ void Worker::init_task(Task* task) noexcept {
 
 Task* Worker::allocate_task() noexcept {
   auto* task = m_freelist.pop_front();
-  if (!task) {
+  if (task) {
+    m_metrics.tasks_free.set(m_metrics.tasks_free.get() - 1);
+  } else {
     task = new Task{};
     task->stack = reinterpret_cast<char*>(std::malloc(Task::STACK_SIZE));
+    m_metrics.tasks_created.add();
+  }
+
+  return task;
+}
+
+Task* Worker::allocate_stackless_task() noexcept {
+  auto* task = m_stackless_freelist.pop_front();
+  if (task) {
+    m_metrics.tasks_free.set(m_metrics.tasks_free.get() - 1);
+  } else {
+    task = new Task{};
+    m_metrics.tasks_created.add();
   }
 
   return task;
@@ -1,28 +1,30 @@
 #pragma once
 
 #include <cassert>
+#include <coroutine>
 #include <cstddef>
 #include <memory>
+#include <mutex>
+#include <source_location>
+#include <type_traits>
 #include <utility>
 #include <system_error>
 
+#include "arena.hpp"
+#include "blocking_pool.hpp"
 #include "handle.hpp"
+#include "connection_pool.hpp"
 #include "cpu_context.hpp"
+#include "frame_pool.hpp"
 #include "io_engine.hpp"
+#include "metrics.hpp"
+#include "placement.hpp"
 #include "worker_queue.hpp"
 #include "task.hpp"
+#include "trace.hpp"
+#include "watchdog.hpp"
 #include "random.hpp"
 
-#if 0
-#include <iostream>
-#define TRACE_TASK(t, msg) \
-  std::cout << "Task[" << (void*)(t->owner) << "|" << (void*)(t) << "]: " msg "\n"
-#else
-#define TRACE_TASK(t, msg) \
-  do {                     \
-  } while (false)
-#endif
-
 namespace rt {
 
 struct TaskList {
@@ -72,11 +74,87 @@ struct TaskList {
   }
 };
 
+// Tasks handed to a worker by other threads
+class TaskInbox {
+ public:
+  TaskInbox() noexcept = default;
+  // NOTE: only valid before worker threads are started
+  TaskInbox(TaskInbox&& other) noexcept : m_tasks(std::move(other.m_tasks)) {
+    m_size.store(other.m_size.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  void push(Task* task) noexcept {
+    std::lock_guard lock(m_mutex);
+    m_tasks.push_back(task);
+    m_size.fetch_add(1, std::memory_order_release);
+  }
+
+  // cheap when there is nothing to take
+  TaskList take() noexcept {
+    if (m_size.load(std::memory_order_acquire) == 0) {
+      return {};
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_size.store(0, std::memory_order_relaxed);
+    return std::move(m_tasks);
+  }
+
+  // approximate, for load balancing
+  std::size_t size() const noexcept { return m_size.load(std::memory_order_relaxed); }
+
+ private:
+  std::mutex m_mutex;
+  TaskList m_tasks;
+  std::atomic<std::size_t> m_size{0};
+};
+
+// Tasks which yielded, run after the ready tasks of their priority. Unlike
+// WorkerQueue it's FIFO, so a yielded task doesn't run again right away,
+// and other workers can take from it too.
+class YieldQueue {
+ public:
+  YieldQueue() noexcept = default;
+  // NOTE: only valid before worker threads are started
+  YieldQueue(YieldQueue&& other) noexcept : m_tasks(std::move(other.m_tasks)) {
+    m_size.store(other.m_size.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  void push(Task* task) noexcept {
+    std::lock_guard lock(m_mutex);
+    m_tasks.push_back(task);
+    m_size.store(m_size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // takes the oldest task, cheap when there is nothing to take. Safe to call
+  // from any thread.
+  Task* pop() noexcept {
+    if (m_size.load(std::memory_order_relaxed) == 0) {
+      return nullptr;
+    }
+
+    std::lock_guard lock(m_mutex);
+    auto* task = m_tasks.pop_front();
+    if (task) {
+      m_size.store(m_size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  std::size_t size() const noexcept { return m_size.load(std::memory_order_relaxed); }
+
+ private:
+  std::mutex m_mutex;
+  TaskList m_tasks;
+  std::atomic<std::size_t> m_size{0};
+};
+
 Task* current_task();
+struct ShardLinks;
 
 class Worker {
  public:
-  Worker(IoEngine io) noexcept;
+  Worker(IoEngine io, BlockingPool* blocking) noexcept;
   Worker(const Worker&) = delete;
   Worker(Worker&&) noexcept = default;
   Worker& operator=(const Worker&) = delete;
@@ -84,31 +162,116 @@ class Worker {
   ~Worker() noexcept;
 
   template <typename F>
-  void spawn(F&& fn) {
+  void spawn(F&& fn, Priority priority = Priority::Normal,
+             Placement placement = Placement::local(),
+             std::source_location location = std::source_location::current()) {
+    schedule(create_task(std::forward<F>(fn), priority, location), placement);
+  }
+
+  // h is a root coroutine, it's resumed by the worker and destroys itself
+  // when done (see co_task.hpp)
+  void spawn_coroutine(std::coroutine_handle<> h, Priority priority = Priority::Normal,
+                       Placement placement = Placement::local(),
+                       std::source_location location = std::source_location::current()) {
+    schedule(create_coroutine_task(h, priority, location), placement);
+  }
+
+  // Tasks are created by the spawning worker and then queued on the one
+  // chosen by placement
+  template <typename F>
+  Task* create_task(F&& fn, Priority priority, std::source_location location) {
     auto* task = allocate_task();
     task->set(std::forward<F>(fn));
+    task->priority = priority;
+    task->spawned_at = location;
     init_task(task);
-    TRACE_TASK(task, "allocated");
-    m_ready.push(task);
+    m_trace.record(TraceEventKind::Spawn, task);
+    m_metrics.spawns.add();
+    return task;
+  }
+  Task* create_coroutine_task(std::coroutine_handle<> h, Priority priority,
+                              std::source_location location) noexcept;
+  void schedule(Task* task, Placement placement) noexcept;
+  // Frees a locally scheduled task without running it, if nothing was
+  // queued after it and it wasn't stolen. Returns false otherwise.
+  // NOTE: task should not have started yet
+  bool take_back(Task* task) noexcept;
+
+  // all workers of the runtime and index of this one, used for placement
+  void set_peers(std::vector<Worker*> all, std::size_t id,
+                 Placement default_placement) noexcept {
+    m_all = std::move(all);
+    m_id = id;
+    m_default_placement = default_placement;
   }
+  // approximate number of queued tasks, safe to call from any thread
+  std::size_t load() const noexcept;
 
   void run(Worker** workers, std::size_t n) noexcept;
 
   friend struct Task;
 
+  // takes the most urgent task, background tasks are stolen only when
+  // there is nothing else
   Task* steal() noexcept {
-    auto* task = m_ready.steal();
-    if (task) {
-      TRACE_TASK(task, "stolen");
-      task->owner = nullptr;
+    if (m_shard) {
+      // shards never share tasks
+      return nullptr;
     }
-    return task;
+
+    for (std::size_t i = 0; i < N_PRIORITIES; ++i) {
+      auto* task = m_ready[i].steal();
+      if (!task) {
+        task = m_yielded[i].pop();
+      }
+
+      if (task) {
+        task->owner = nullptr;
+        return task;
+      }
+    }
+    return nullptr;
   }
   IoEngine* io() noexcept { return &m_io; }
+  // safe to call from any thread, task is made ready by this worker, which
+  // is woken up if it's idle
+  void inject(Task* task) noexcept {
+    m_inbox.push(task);
+    m_io.interrupt();
+  }
+  // makes a parked task ready, should be called on this worker's thread
+  void wake(Task* task) noexcept {
+    m_trace.record(TraceEventKind::Wake, task);
+    make_woken(task);
+  }
+  // shard mode, see RuntimeConfig::sharded
+  void set_shard(ShardLinks* links) noexcept { m_shard = links; }
+  ShardLinks* shard() const noexcept { return m_shard; }
+  // runs messages received from other shards, returns their number
+  std::size_t poll_shard() noexcept;
+  const Heartbeat& heartbeat() const noexcept { return m_heartbeat; }
+  // safe to call from any thread
+  WorkerMetricsSnapshot metrics() const noexcept;
+  std::vector<TraceEvent> trace() const { return m_trace.snapshot(); }
+  // runs job on the blocking pool, current task is parked until it's done
+  void run_blocking(detail::BlockingJob* job) noexcept;
+  ConnectionPool* connections() noexcept { return &m_connections; }
+  ChunkPool* chunk_pool() noexcept { return &m_chunks; }
+  FramePool* frame_pool() noexcept { return &m_frames; }
 
  private:
   void run(CpuContext* current) noexcept;
-  bool wait_io() noexcept;
+  bool wait_io(std::size_t wait_ms) noexcept;
+
+  void make_ready(Task* task) noexcept {
+    task->ready_at = monotonic_ns();
+    m_ready[static_cast<std::size_t>(task->priority)].push(task);
+  }
+
+  // like make_ready(), but keeps the task on this worker unless overloaded
+  void make_woken(Task* task) noexcept;
+  Task* pop_ready() noexcept;
+  Task* pop_class(std::size_t priority) noexcept;
 
   Task* next_task() noexcept;
   Task* try_steal() noexcept;
@@ -116,26 +279,67 @@ class Worker {
   void init_task(Task* task) noexcept;
 
   Task* allocate_task() noexcept;
+  Task* allocate_stackless_task() noexcept;
   void release_task(Task* task) noexcept;
 
   IoEngine m_io;
+  ConnectionPool m_connections;  // NOTE: should be destroyed before m_io
+  BlockingPool* m_blocking{nullptr};
   std::size_t m_io_blocked{0};
   CpuContext m_main{};
+  ChunkPool m_chunks{};  // backs task arenas
   TaskList m_freelist{};  // cached free tasks
                           // TODO: add a limit on how many tasks can be cached
-  WorkerQueue m_ready{};  // ready tasks
+  TaskList m_stackless_freelist{};
+  FramePool m_frames{};   // coroutine frames
+  WorkerQueue m_ready[N_PRIORITIES]{};  // ready tasks, one queue per priority
+  std::uint32_t m_tick{0};              // drives weighted selection in pop_ready()
+  TaskList m_woken[N_PRIORITIES]{};     // woken tasks, not stealable
+  Counter m_n_woken{};
+  YieldQueue m_yielded[N_PRIORITIES]{};  // run after ready tasks of the class
+  Task* m_yielding{nullptr};            // queued once switched out
+  TaskInbox m_inbox{};
+  std::uint32_t m_since_poll{0};        // tasks picked since IO was last polled
 
   XorShiftRng m_rng{};
   Worker** m_workers{nullptr};
   std::size_t m_n_workers{0};
+  std::vector<Worker*> m_all{};
+  std::size_t m_id{0};
+  std::size_t m_round_robin{0};
+  Placement m_default_placement{Placement::local()};
+  ShardLinks* m_shard{nullptr};
+
+  WorkerMetrics m_metrics{};
+  Heartbeat m_heartbeat{};
+  TraceBuffer m_trace{};
 };
 
 void yield();
+// Counts a unit of work done without parking (e.g. a read served from a
+// buffer) against the current task's budget, yields once it's exhausted.
+// Loops that can run for long without blocking should call it too.
+void consume_budget();
+
+template <typename F>
+void spawn(F&& fn, Priority priority = Priority::Normal,
+           Placement placement = Placement::local(),
+           std::source_location location = std::source_location::current()) {
+  auto* task = current_task();
+  task->owner->spawn(std::forward<F>(fn), priority, placement, location);
+}
 
+// Runs fn on the blocking pool and returns its result. Only the calling task
+// waits for it, other tasks of the worker keep running.
+// NOTE: fn should not throw
 template <typename F>
-void spawn(F&& fn) {
+auto spawn_blocking(F&& fn) {
+  using Fn = std::remove_reference_t<F>;
+  using T = std::invoke_result_t<Fn&>;
   auto* task = current_task();
-  task->owner->spawn(std::forward<F>(fn));
+  detail::BlockingJobImpl<Fn, T> job{task, fn};
+  task->owner->run_blocking(&job);
+  return job.take();
 }
 
 }  // namespace rt
\ No newline at end of file
@@ -24,7 +24,8 @@ class WorkerQueue {
       : m_top{other.m_top.load()},
         m_bottom{other.m_bottom.load()},
         m_array{other.m_array.load()},
-        m_garbage{std::move(other.m_garbage)} {
+        m_garbage{std::move(other.m_garbage)},
+        m_grows{other.m_grows.load()} {
     other.m_top = 0;
     other.m_bottom = 0;
     other.m_array = nullptr;
@@ -69,6 +70,11 @@ class WorkerQueue {
     return static_cast<std::size_t>(b >= t ? b - t : 0);
   }
 
+  // number of times the array was grown, safe to call from any thread
+  std::uint64_t grows() const noexcept {
+    return m_grows.load(std::memory_order_relaxed);
+  }
+
   void push(Task* task) noexcept {
     auto b = m_bottom.load(std::memory_order_relaxed);
     auto t = m_top.load(std::memory_order_acquire);
@@ -79,6 +85,8 @@ class WorkerQueue {
       m_garbage.push_back(a);
       std::swap(a, tmp);
       m_array.store(a, std::memory_order_release);
+      m_grows.store(m_grows.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
     }
 
     a->push(b, task);
@@ -147,6 +155,7 @@ class WorkerQueue {
 
   std::atomic<Array*> m_array;
   std::vector<Array*> m_garbage;
+  std::atomic<std::uint64_t> m_grows{0};
 };
 
 } // namespace rt
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <iostream>
+#include <system_error>
+#include <utility>
+
+#include "rt/buf_reader.hpp"
+#include "rt/buf_writer.hpp"
+#include "rt/http_parser.hpp"
+#include "rt/stream.hpp"
+#include "rt/worker.hpp"
+
+
+// Parses the next request buffered in the reader, receives more data only if
+// there is no complete request buffered yet. Responses to pipelined requests
+// are flushed together right before blocking on recv(). Returns false if
+// connection should be closed.
+inline bool receive_request(rt::BufReader& in, rt::BufWriter& out,
+                            rt::HttpParser& parser, rt::HttpRequest& request) {
+  while (true) {
+    const auto data = in.contiguous();
+    switch (parser.parse(data.data(), data.size(), request)) {
+      case rt::ParseStatus::Complete:
+        return true;
+      case rt::ParseStatus::Error:
+        std::cout << "invalid request" << std::endl;
+        return false;
+      case rt::ParseStatus::Incomplete:
+        break;
+    }
+
+    if (auto e = out.flush()) {
+      std::cout << "send() failed: " << e.message() << std::endl;
+      return false;
+    }
+
+    auto n = in.fill();
+    if (auto e = n.err()) {
+      std::cout << "recv() failed: " << e.message() << std::endl;
+      return false;
+    }
+
+    if (*n == 0) {
+      return false;
+    }
+  }
+}
+
+// Answers every request on the connection with "Hello, world!" until the
+// client closes it or asks to.
+inline void serve_hello_world(rt::StreamRef c) {
+  rt::HttpParser parser;
+  rt::HttpRequest request;
+  rt::BufReader in(c, 4096);
+  rt::BufWriter out(c);
+  while (receive_request(in, out, parser, request)) {
+    // NOTE: request views stay valid, consume() doesn't move data
+    in.consume(parser.consumed());
+
+    const char response[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 13\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n"
+        "Hello, world!";
+
+    if (auto e = out.write(response, sizeof(response) - 1)) {
+      std::cout << "send() failed: " << e.message() << std::endl;
+      break;
+    }
+
+    if (!request.keep_alive) {
+      break;
+    }
+  }
+
+  if (auto e = out.flush()) {
+    std::cout << "send() failed: " << e.message() << std::endl;
+  }
+
+  if (auto e = c.shutdown()) {
+    std::cout << "shutdown() failed: " << e.message() << std::endl;
+  }
+}
+
+// Accepts connections until the listener fails and serves each of them in
+// its own task. Works with Socket and LoopbackListener.
+template <typename Listener>
+void accept_hello_world(Listener& listener) {
+  while (true) {
+    auto client = listener.accept();
+    if (auto e = client.err()) {
+      std::cout << "accept() failed: " << e.message() << std::endl;
+      return;
+    }
+
+    rt::spawn([c = std::move(*client)]() mutable { serve_hello_world(c); },
+              rt::Priority::Critical, rt::Placement::least_loaded());
+  }
+}